@@ -0,0 +1,414 @@
+/**
+ * Compares the out-edge access of her::Graph with the one of
+ * boost::compressed_sparse_row_graph, which her::Graph was built on before.
+ * Both graphs are built from the same random edges, with the same vertex and
+ * edge data types as the graphs of HER. Three workloads are timed:
+ *
+ *  - degree: the sum of the out-degrees of all vertices
+ *  - scan: a pass over all out-edges reading their targets and edge data
+ *  - bfs: bounded breadth-first searches from random sources
+ *
+ * her::Graph is measured through the edge iterators used by the algorithms
+ * (GetOutgoingAdjList, target, operator[]), through the spans of
+ * OutNeighbors and OutEdgeData and through VisitOutEdges. A copy of it with
+ * compressed edges (her-zip, see -compress_g) is measured through the
+ * iterators and VisitOutEdges, the bytes per edge of both and the edges per
+ * second scanned by bfs are reported. Every workload computes a checksum,
+ * equal checksums show that all variants visit the same edges. Compressed
+ * rows are sorted by target, so bfs may reach a vertex over another edge
+ * there, only the number of scanned edges is compared for them.
+ */
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <boost/graph/compressed_sparse_row_graph.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "her/config.h"
+#include "her/csr_builder.h"
+#include "her/graph.h"
+#include "her/timer.h"
+
+DEFINE_int64(bench_vertices, 1 << 20, "Number of vertices");
+DEFINE_int32(bench_degree, 8, "Average out-degree");
+DEFINE_int32(bench_rounds, 5, "Repetitions of every workload");
+DEFINE_int32(bench_sources, 64, "Sources of the bfs workload");
+DEFINE_int32(bench_depth, 3, "Depth limit of the bfs workload");
+DEFINE_int32(bench_edge_labels, 32, "Number of distinct edge labels");
+DEFINE_int32(bench_seed, 1, "Seed of the random graph");
+DEFINE_int32(parallelism, 1, "Number of threads building the CSR");
+
+namespace {
+using oid_t = int64_t;
+using vid_t = uint32_t;
+using vdata_t = her::label_id_t;
+using edata_t = her::edge_label_id_t;
+using graph_t = her::Graph<oid_t, vid_t, vdata_t, edata_t>;
+using boost_graph_t =
+    boost::compressed_sparse_row_graph<boost::directedS, vdata_t, edata_t,
+                                       boost::no_property, vid_t, size_t>;
+
+/**
+ * Run func rounds times and print the best time. The checksum of the last
+ * round is returned.
+ */
+template <typename FUNC_T>
+uint64_t Measure(const char* workload, const char* variant, int rounds,
+                 const FUNC_T& func, double* best_time = nullptr) {
+  double best = 0;
+  uint64_t checksum = 0;
+
+  for (int i = 0; i < rounds; i++) {
+    double begin = timer();
+
+    checksum = func();
+
+    double time = timer() - begin;
+
+    if (i == 0 || time < best) {
+      best = time;
+    }
+  }
+  printf("%-8s %-10s %10.4f sec  checksum %llu\n", workload, variant, best,
+         static_cast<unsigned long long>(checksum));
+  if (best_time != nullptr) {
+    *best_time = best;
+  }
+  return checksum;
+}
+
+/**
+ * Visit the vertices within depth hops of every source, level by level.
+ * for_each_target(u, visit) calls visit(v, data) for every out-edge (u, v),
+ * the number of these calls is n_scanned.
+ */
+template <typename FOR_EACH_TARGET_T>
+uint64_t Bfs(size_t n_vertices, const std::vector<vid_t>& sources, int depth,
+             uint64_t& n_scanned, const FOR_EACH_TARGET_T& for_each_target) {
+  std::vector<bool> visited(n_vertices, false);
+  std::vector<vid_t> frontier, next, touched;
+  uint64_t checksum = 0;
+
+  n_scanned = 0;
+  for (auto src : sources) {
+    frontier.assign(1, src);
+    touched.assign(1, src);
+    visited[src] = true;
+    for (int d = 0; d < depth && !frontier.empty(); d++) {
+      for (auto u : frontier) {
+        for_each_target(u, [&](vid_t v, edata_t data) {
+          n_scanned++;
+          if (!visited[v]) {
+            visited[v] = true;
+            next.push_back(v);
+            touched.push_back(v);
+            checksum += v + data;
+          }
+        });
+      }
+      frontier.swap(next);
+      next.clear();
+    }
+    for (auto v : touched) {
+      visited[v] = false;
+    }
+  }
+  return checksum;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  gflags::SetUsageMessage("Usage: " + std::string(argv[0]) +
+                          " [-bench_vertices n] [-bench_degree d] ...");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  CHECK_GT(FLAGS_bench_vertices, 0) << "Invalid param: -bench_vertices";
+  CHECK_GT(FLAGS_bench_edge_labels, 0) << "Invalid param: -bench_edge_labels";
+
+  size_t n_vertices = FLAGS_bench_vertices;
+  size_t n_edges = n_vertices * FLAGS_bench_degree;
+  std::mt19937_64 rng(FLAGS_bench_seed);
+  std::uniform_int_distribution<vid_t> vertex_dist(0, n_vertices - 1);
+  std::uniform_int_distribution<int> label_dist(0,
+                                                FLAGS_bench_edge_labels - 1);
+  std::vector<std::pair<vid_t, vid_t>> edges;
+  std::vector<edata_t> edge_data;
+
+  // Sources are skewed towards small ids, so degrees vary like in real graphs
+  edges.reserve(n_edges);
+  edge_data.reserve(n_edges);
+  for (size_t i = 0; i < n_edges; i++) {
+    vid_t src = std::min(vertex_dist(rng), vertex_dist(rng));
+
+    edges.emplace_back(src, vertex_dist(rng));
+    edge_data.push_back(label_dist(rng));
+  }
+
+  double begin = timer();
+  boost_graph_t boost_graph(boost::edges_are_unsorted_multi_pass,
+                            edges.begin(), edges.end(), edge_data.begin(),
+                            n_vertices);
+
+  printf("Built the boost CSR in %.4f sec\n", timer() - begin);
+
+  begin = timer();
+
+  her::CsrBuilder<vid_t, edata_t> builder(n_vertices, FLAGS_parallelism);
+  std::vector<typename her::CsrBuilder<vid_t, edata_t>::Chunk> chunks(1);
+  auto csr = std::make_shared<graph_t::csr_t>();
+
+  chunks[0] = builder.NewChunk();
+  for (size_t i = 0; i < n_edges; i++) {
+    builder.Add(chunks[0], edges[i].first, edges[i].second, edge_data[i]);
+  }
+  builder.Build(chunks, *csr);
+  csr->vertex_data.Mutable().assign(n_vertices, 0);
+  printf("Built the CSR of her::Graph in %.4f sec\n", timer() - begin);
+
+  auto vm = std::make_shared<graph_t::vertex_map_t>();
+  std::vector<oid_t> oids(n_vertices);
+  oid_t duplicate;
+
+  for (size_t v = 0; v < n_vertices; v++) {
+    oids[v] = v;
+  }
+  CHECK(vm->BulkBuild(std::move(oids), 1, duplicate));
+
+  graph_t graph(vm, csr, std::make_shared<her::LabelDictionary>(),
+                std::make_shared<her::TokenTable>(),
+                std::make_shared<her::LabelDictionary>(),
+                std::make_shared<her::LabelDictionary>());
+  std::vector<vid_t> sources;
+
+  for (int i = 0; i < FLAGS_bench_sources; i++) {
+    sources.push_back(std::min(vertex_dist(rng), vertex_dist(rng)));
+  }
+  edges = std::vector<std::pair<vid_t, vid_t>>();
+  edge_data = std::vector<edata_t>();
+
+  graph_t zip_graph(vm, std::make_shared<graph_t::csr_t>(*csr),
+                    std::make_shared<her::LabelDictionary>(),
+                    std::make_shared<her::TokenTable>(),
+                    std::make_shared<her::LabelDictionary>(),
+                    std::make_shared<her::LabelDictionary>());
+
+  begin = timer();
+  zip_graph.CompressEdges(FLAGS_parallelism);
+  printf("Compressed the edges in %.4f sec\n", timer() - begin);
+  printf("her      %.3f bytes per edge\n",
+         static_cast<double>(graph.EdgeBytes()) / n_edges);
+  printf("her-zip  %.3f bytes per edge\n",
+         static_cast<double>(zip_graph.EdgeBytes()) / n_edges);
+
+  int rounds = FLAGS_bench_rounds;
+
+  printf("%zu vertices, %zu edges, best of %d rounds\n", n_vertices, n_edges,
+         rounds);
+
+  auto boost_degree = Measure("degree", "boost", rounds, [&]() {
+    uint64_t sum = 0;
+
+    for (auto v : boost::make_iterator_range(boost::vertices(boost_graph))) {
+      sum += boost::out_degree(v, boost_graph);
+    }
+    return sum;
+  });
+  auto degree = Measure("degree", "her", rounds, [&]() {
+    uint64_t sum = 0;
+
+    for (auto v : graph.Vertices()) {
+      sum += graph.OutDegree(v);
+    }
+    return sum;
+  });
+  auto zip_degree = Measure("degree", "her-zip", rounds, [&]() {
+    uint64_t sum = 0;
+
+    for (auto v : zip_graph.Vertices()) {
+      sum += zip_graph.OutDegree(v);
+    }
+    return sum;
+  });
+
+  CHECK_EQ(boost_degree, degree);
+  CHECK_EQ(boost_degree, zip_degree);
+
+  auto boost_scan = Measure("scan", "boost", rounds, [&]() {
+    uint64_t sum = 0;
+
+    for (auto v : boost::make_iterator_range(boost::vertices(boost_graph))) {
+      for (auto e :
+           boost::make_iterator_range(boost::out_edges(v, boost_graph))) {
+        sum += boost::target(e, boost_graph) + boost_graph[e];
+      }
+    }
+    return sum;
+  });
+  auto adj_scan = Measure("scan", "her-adj", rounds, [&]() {
+    uint64_t sum = 0;
+
+    for (auto v : graph.Vertices()) {
+      for (auto& e : graph.GetOutgoingAdjList(v)) {
+        sum += graph.target(e) + graph[e];
+      }
+    }
+    return sum;
+  });
+  auto span_scan = Measure("scan", "her-span", rounds, [&]() {
+    uint64_t sum = 0;
+
+    for (auto v : graph.Vertices()) {
+      auto neighbors = graph.OutNeighbors(v);
+      auto data = graph.OutEdgeData(v);
+
+      for (size_t i = 0; i < neighbors.size(); i++) {
+        sum += neighbors[i] + data[i];
+      }
+    }
+    return sum;
+  });
+  auto visit_scan = Measure("scan", "her-visit", rounds, [&]() {
+    uint64_t sum = 0;
+
+    for (auto v : graph.Vertices()) {
+      graph.VisitOutEdges(v, {}, [&sum](vid_t u, edata_t data) {
+        sum += u + data;
+        return true;
+      });
+    }
+    return sum;
+  });
+  auto zip_adj_scan = Measure("scan", "zip-adj", rounds, [&]() {
+    uint64_t sum = 0;
+
+    for (auto v : zip_graph.Vertices()) {
+      for (auto& e : zip_graph.GetOutgoingAdjList(v)) {
+        sum += zip_graph.target(e) + zip_graph[e];
+      }
+    }
+    return sum;
+  });
+  auto zip_visit_scan = Measure("scan", "zip-visit", rounds, [&]() {
+    uint64_t sum = 0;
+
+    for (auto v : zip_graph.Vertices()) {
+      zip_graph.VisitOutEdges(v, {}, [&sum](vid_t u, edata_t data) {
+        sum += u + data;
+        return true;
+      });
+    }
+    return sum;
+  });
+
+  CHECK_EQ(boost_scan, adj_scan);
+  CHECK_EQ(boost_scan, span_scan);
+  CHECK_EQ(boost_scan, visit_scan);
+  CHECK_EQ(boost_scan, zip_adj_scan);
+  CHECK_EQ(boost_scan, zip_visit_scan);
+
+  int depth = FLAGS_bench_depth;
+  uint64_t n_scanned, zip_n_scanned;
+  double time;
+  auto report = [&](const char* variant, uint64_t n) {
+    printf("bfs      %-10s %10.0f edges/sec\n", variant, n / time);
+  };
+  auto boost_bfs = Measure(
+      "bfs", "boost", rounds,
+      [&]() {
+        return Bfs(n_vertices, sources, depth, n_scanned,
+                   [&](vid_t u, const auto& visit) {
+                     for (auto e : boost::make_iterator_range(
+                              boost::out_edges(u, boost_graph))) {
+                       visit(boost::target(e, boost_graph), boost_graph[e]);
+                     }
+                   });
+      },
+      &time);
+  report("boost", n_scanned);
+
+  auto adj_bfs = Measure(
+      "bfs", "her-adj", rounds,
+      [&]() {
+        return Bfs(n_vertices, sources, depth, n_scanned,
+                   [&](vid_t u, const auto& visit) {
+                     for (auto& e : graph.GetOutgoingAdjList(u)) {
+                       visit(graph.target(e), graph[e]);
+                     }
+                   });
+      },
+      &time);
+  report("her-adj", n_scanned);
+
+  auto span_bfs = Measure(
+      "bfs", "her-span", rounds,
+      [&]() {
+        return Bfs(n_vertices, sources, depth, n_scanned,
+                   [&](vid_t u, const auto& visit) {
+                     auto neighbors = graph.OutNeighbors(u);
+                     auto data = graph.OutEdgeData(u);
+
+                     for (size_t i = 0; i < neighbors.size(); i++) {
+                       visit(neighbors[i], data[i]);
+                     }
+                   });
+      },
+      &time);
+  report("her-span", n_scanned);
+
+  auto visit_bfs = Measure(
+      "bfs", "her-visit", rounds,
+      [&]() {
+        return Bfs(n_vertices, sources, depth, n_scanned,
+                   [&](vid_t u, const auto& visit) {
+                     graph.VisitOutEdges(u, {}, [&](vid_t v, edata_t data) {
+                       visit(v, data);
+                       return true;
+                     });
+                   });
+      },
+      &time);
+  report("her-visit", n_scanned);
+
+  Measure(
+      "bfs", "zip-adj", rounds,
+      [&]() {
+        return Bfs(n_vertices, sources, depth, zip_n_scanned,
+                   [&](vid_t u, const auto& visit) {
+                     for (auto& e : zip_graph.GetOutgoingAdjList(u)) {
+                       visit(zip_graph.target(e), zip_graph[e]);
+                     }
+                   });
+      },
+      &time);
+  report("zip-adj", zip_n_scanned);
+  CHECK_EQ(n_scanned, zip_n_scanned);
+
+  Measure(
+      "bfs", "zip-visit", rounds,
+      [&]() {
+        return Bfs(n_vertices, sources, depth, zip_n_scanned,
+                   [&](vid_t u, const auto& visit) {
+                     zip_graph.VisitOutEdges(u, {}, [&](vid_t v, edata_t data) {
+                       visit(v, data);
+                       return true;
+                     });
+                   });
+      },
+      &time);
+  report("zip-visit", zip_n_scanned);
+  CHECK_EQ(n_scanned, zip_n_scanned);
+
+  CHECK_EQ(boost_bfs, adj_bfs);
+  CHECK_EQ(boost_bfs, span_bfs);
+  CHECK_EQ(boost_bfs, visit_bfs);
+
+  google::ShutdownGoogleLogging();
+  return 0;
+}
@@ -8,6 +8,7 @@
 #include "her/graph.h"
 #include "her/inverted_index.h"
 #include "her/processing_utils.h"
+#include "her/source_vertices.h"
 #include "her/spair.h"
 #include "her/util.h"
 
@@ -20,15 +21,15 @@ class APairParallel {
 
  public:
   APairParallel(GRAPH& gd, GRAPH& g, H_V& h_v, H_P& h_p, H_R& h_r,
-                const std::unordered_set<std::string>& gd_source_labels,
-                const std::unordered_set<std::string>& g_source_labels,
+                const SourceVertices<GRAPH>& gd_source_vertices,
+                const SourceVertices<GRAPH>& g_source_vertices,
                 const InvertedIndex<GRAPH>& inverted_index)
       : gd_(gd),
         g_(g),
         h_v_(h_v),
         s_pair_(gd, g, h_v, h_p, h_r),
-        gd_source_labels_(gd_source_labels),
-        g_source_labels_(g_source_labels),
+        gd_source_vertices_(gd_source_vertices),
+        g_source_vertices_(g_source_vertices),
         inverted_index_(inverted_index) {}
 
   void InitParams(double sigma, double delta, int k, int parallelism) {
@@ -47,6 +48,9 @@ class APairParallel {
 
       std::vector<vertex_t> vertices;
 
+      // SPair results depend on the order of queries through its cache, so
+      // all vertices are shuffled and split, and the vertices without
+      // candidates are skipped only then
       if (world.rank() == 0) {
         for (auto v : gd_.Vertices()) {
           vertices.push_back(v);
@@ -79,41 +83,31 @@ class APairParallel {
               size_t seen_n_points = 0;
 
               for (auto u : vertices_of_gd) {
-                if (gd_.OutDegree(u) == 0) {
+                // Only source vertices of GD have candidates
+                if (!gd_source_vertices_.Contains(u)) {
                   continue;
                 }
-                auto& u_label = gd_[u];
 
-                if (gd_source_labels_.find(u_label) !=
-                    gd_source_labels_.end()) {
-                  std::vector<vertex_t> vertices;  // vertices of g
+                std::vector<vertex_t> vertices;  // vertices of g
 
-                  if (seen_n_points++ % 500 == 0) {
-                    VLOG(2) << "Rank: " << rank << " "
-                            << (GetCurrentTime() - query_begin) / seen_n_points
-                            << " seconds/point";
-                  }
-                  auto v_list = inverted_index_.Query(u_label);
-
-                  for (auto& v : v_list) {
-                    if (g_.OutDegree(v) == 0) {
-                      continue;
-                    }
-                    auto& v_label = g_[v];
-
-                    if (g_source_labels_.find(v_label) !=
-                        g_source_labels_.end()) {
-                      // We filter vertex pair before query
-                      if (h_v_(gd_, u, g_, v) >= sigma_) {
-                        vertices.push_back(v);
-                      }
-                    }
-                  }
+                if (seen_n_points++ % 500 == 0) {
+                  VLOG(2) << "Rank: " << rank << " "
+                          << (GetCurrentTime() - query_begin) / seen_n_points
+                          << " seconds/point";
+                }
+                auto v_list = inverted_index_.Query(gd_.GetTokens(u));
 
-                  if (!vertices.empty()) {
-                    local_C.template emplace_back(u, vertices);
+                for (auto& v : v_list) {
+                  // We filter vertex pair before query
+                  if (g_source_vertices_.Contains(v) &&
+                      h_v_(gd_, u, g_, v) >= sigma_) {
+                    vertices.push_back(v);
                   }
                 }
+
+                if (!vertices.empty()) {
+                  local_C.template emplace_back(u, vertices);
+                }
               }
 
               {
@@ -190,8 +184,8 @@ class APairParallel {
   double sigma_{};
   int parallelism_{};
   SPair<GRAPH, H_V, H_P, H_R> s_pair_;
-  const std::unordered_set<std::string>& gd_source_labels_;
-  const std::unordered_set<std::string>& g_source_labels_;
+  const SourceVertices<GRAPH>& gd_source_vertices_;
+  const SourceVertices<GRAPH>& g_source_vertices_;
   const InvertedIndex<GRAPH>& inverted_index_;
 };
 }  // namespace her
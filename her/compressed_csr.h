@@ -0,0 +1,291 @@
+#ifndef HER_COMPRESSED_CSR_H_
+#define HER_COMPRESSED_CSR_H_
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+#include "her/memory_policy.h"
+#include "her/snapshot.h"
+#include "her/worker_pool.h"
+
+namespace her {
+// Edges of a compressed row are coded in blocks of this many edges, every
+// block can be decoded on its own
+static constexpr size_t kCompressedBlockEdges = 64;
+
+// Append value as a varint, 7 bits per byte, low bits first
+template <typename BYTES_T>
+inline void WriteVarint(uint64_t value, BYTES_T& out) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+inline uint64_t ReadVarint(const uint8_t*& p) {
+  uint64_t value = *p & 0x7f;
+
+  for (int shift = 7; *p++ & 0x80; shift += 7) {
+    value |= static_cast<uint64_t>(*p & 0x7f) << shift;
+  }
+  return value;
+}
+
+/**
+ * Decodes the edges of a compressed row one by one, see CompressedRows.
+ */
+template <typename VID_T, typename EDATA_T>
+class CompressedRowCursor {
+ public:
+  CompressedRowCursor() = default;
+
+  // remaining edges follow the block starting at p
+  CompressedRowCursor(const uint8_t* p, size_t remaining)
+      : p_(p), remaining_(remaining) {}
+
+  // Decode the next edge, false if the row is exhausted
+  bool Next() {
+    if (remaining_ == 0) {
+      return false;
+    }
+    if (in_block_ == 0) {
+      dst_ = static_cast<VID_T>(ReadVarint(p_));
+      in_block_ = kCompressedBlockEdges;
+    } else {
+      dst_ += static_cast<VID_T>(ReadVarint(p_));
+    }
+    data_ = static_cast<EDATA_T>(ReadVarint(p_));
+    in_block_--;
+    remaining_--;
+    return true;
+  }
+
+  // The edges not decoded yet
+  size_t remaining() const { return remaining_; }
+
+  VID_T dst() const { return dst_; }
+
+  const EDATA_T& data() const { return data_; }
+
+ private:
+  const uint8_t* p_{};
+  size_t remaining_{};
+  size_t in_block_{};
+  VID_T dst_{};
+  EDATA_T data_{};
+};
+
+/**
+ * The out-edges of a graph with the neighbors of every row sorted and gap
+ * coded. Row v is the bytes [offsets[v], offsets[v + 1]) of codes:
+ *
+ *  - the degree, as a varint
+ *  - a skip entry for every block but the first one if the row has more
+ *    than one block: the byte offset of the block from the end of the skip
+ *    entries (uint64_t) and its first neighbor (VID_T)
+ *  - the edges in blocks of kCompressedBlockEdges, the first neighbor of a
+ *    block as a varint, every other neighbor as a varint of its gap to the
+ *    previous one, each followed by the edge data as a varint
+ *
+ * Parallel edges keep their order. A row with n edges of small gaps and
+ * data takes about 2n bytes, instead of n * (sizeof(VID_T) +
+ * sizeof(EDATA_T)) bytes in a CSR.
+ */
+template <typename VID_T, typename EDATA_T>
+struct CompressedRows {
+  using cursor_t = CompressedRowCursor<VID_T, EDATA_T>;
+
+  static constexpr size_t kSkipBytes = sizeof(uint64_t) + sizeof(VID_T);
+
+  using row_t = std::vector<std::pair<VID_T, EDATA_T>>;
+
+  // Owned under the large array policy, or used in place from a snapshot
+  CowArray<uint64_t, LargeArrayAllocator<uint64_t>> offsets;
+  CowArray<uint8_t, LargeArrayAllocator<uint8_t>> codes;
+
+  bool empty() const { return offsets.empty(); }
+
+  size_t Bytes() const {
+    return offsets.size() * sizeof(uint64_t) + codes.size();
+  }
+
+  size_t Degree(VID_T v) const {
+    const uint8_t* p = codes.data() + offsets[v];
+
+    return ReadVarint(p);
+  }
+
+  // A cursor over the edges of row v
+  cursor_t Row(VID_T v) const {
+    const uint8_t* p = codes.data() + offsets[v];
+    size_t degree = ReadVarint(p);
+
+    return cursor_t(p + NumSkips(degree) * kSkipBytes, degree);
+  }
+
+  /**
+   * Find the first edge from v to dst, the skip entries lead to the only
+   * block that may hold it.
+   */
+  bool Find(VID_T v, VID_T dst, EDATA_T& data) const {
+    const uint8_t* p = codes.data() + offsets[v];
+    size_t degree = ReadVarint(p);
+    size_t n_skips = NumSkips(degree);
+    const uint8_t* edges = p + n_skips * kSkipBytes;
+    // The last block whose first neighbor is less than dst, parallel edges
+    // to dst may start in the block before the first one starting at dst
+    size_t lo = 0, hi = n_skips;
+
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      VID_T first;
+
+      memcpy(&first, p + mid * kSkipBytes + sizeof(uint64_t), sizeof(VID_T));
+      if (first < dst) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+
+    uint64_t block_offset = 0;
+
+    if (lo > 0) {
+      memcpy(&block_offset, p + (lo - 1) * kSkipBytes, sizeof(uint64_t));
+    }
+
+    cursor_t cursor(edges + block_offset, degree - lo * kCompressedBlockEdges);
+
+    while (cursor.Next() && cursor.dst() <= dst) {
+      if (cursor.dst() == dst) {
+        data = cursor.data();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Compress the rows of csr by parallelism threads
+  template <typename CSR_T>
+  void Build(const CSR_T& csr, int parallelism) {
+    size_t n_vertices = csr.VertexNum();
+    size_t n_ranges = std::max(parallelism, 1);
+
+    Build(n_vertices, (n_vertices + n_ranges - 1) / n_ranges, parallelism,
+          [&csr](size_t begin, size_t end, const auto& encode) {
+            row_t row;
+
+            for (size_t v = begin; v < end; v++) {
+              auto neighbors = csr.Neighbors(v);
+              auto edge_data = csr.EdgeData(v);
+
+              row.clear();
+              for (size_t j = 0; j < neighbors.size(); j++) {
+                row.emplace_back(neighbors[j], edge_data[j]);
+              }
+              encode(v, row);
+            }
+          });
+  }
+
+  /**
+   * Compress the rows of n_vertices vertices by parallelism threads. The
+   * vertices are split into ranges of range_width, for every range
+   * fill(begin, end, encode) calls encode(v, row) for all v in [begin, end)
+   * in order, row holding the edges of v as pairs of neighbor and data. Every
+   * range is coded into a buffer of its own, and the buffers are
+   * concatenated in row order.
+   */
+  template <typename FILL_T>
+  void Build(size_t n_vertices, size_t range_width, int parallelism,
+             const FILL_T& fill) {
+    range_width = std::max<size_t>(range_width, 1);
+
+    size_t n_ranges = (n_vertices + range_width - 1) / range_width;
+    size_t n_threads = std::min<size_t>(std::max(parallelism, 1), n_ranges);
+    std::vector<std::vector<uint8_t>> buffers(n_ranges);
+    large_vector_t<uint64_t> row_ends(n_vertices + 1, 0);
+    std::atomic<size_t> next_range(0);
+
+    ParallelFor(n_threads, [&](size_t) {
+      for (size_t i = next_range++; i < n_ranges; i = next_range++) {
+        auto& buffer = buffers[i];
+        auto encode = [&buffer, &row_ends](size_t v, row_t& row) {
+          std::stable_sort(row.begin(), row.end(),
+                           [](const std::pair<VID_T, EDATA_T>& a,
+                              const std::pair<VID_T, EDATA_T>& b) {
+                             return a.first < b.first;
+                           });
+          EncodeRow(row, buffer);
+          // The end of the row in the buffer for now, made global below
+          row_ends[v + 1] = buffer.size();
+        };
+
+        fill(i * range_width, std::min((i + 1) * range_width, n_vertices),
+             encode);
+      }
+    });
+
+    std::vector<uint64_t> bases(n_ranges + 1, 0);
+    large_vector_t<uint8_t> all_codes;
+
+    for (size_t i = 0; i < n_ranges; i++) {
+      bases[i + 1] = bases[i] + buffers[i].size();
+    }
+    all_codes.resize(bases.back());
+    ParallelFor(n_threads, [&](size_t t) {
+      for (size_t i = t; i < n_ranges; i += n_threads) {
+        size_t begin = i * range_width;
+        size_t end = std::min(begin + range_width, n_vertices);
+
+        std::copy(buffers[i].begin(), buffers[i].end(),
+                  all_codes.begin() + bases[i]);
+        for (size_t v = begin; v < end; v++) {
+          row_ends[v + 1] += bases[i];
+        }
+        std::vector<uint8_t>().swap(buffers[i]);
+      }
+    });
+    offsets = std::move(row_ends);
+    codes = std::move(all_codes);
+  }
+
+ private:
+  static size_t NumSkips(size_t degree) {
+    return degree == 0 ? 0 : (degree - 1) / kCompressedBlockEdges;
+  }
+
+  static void EncodeRow(const row_t& row, std::vector<uint8_t>& out) {
+    size_t n_skips = NumSkips(row.size());
+    size_t skips = 0, edges = 0;
+
+    WriteVarint(row.size(), out);
+    skips = out.size();
+    out.resize(out.size() + n_skips * kSkipBytes);
+    edges = out.size();
+    for (size_t j = 0; j < row.size(); j++) {
+      if (j % kCompressedBlockEdges == 0) {
+        if (j > 0) {
+          uint64_t block_offset = out.size() - edges;
+          auto* skip = &out[skips + (j / kCompressedBlockEdges - 1) *
+                                        kSkipBytes];
+
+          memcpy(skip, &block_offset, sizeof(uint64_t));
+          memcpy(skip + sizeof(uint64_t), &row[j].first, sizeof(VID_T));
+        }
+        WriteVarint(row[j].first, out);
+      } else {
+        WriteVarint(row[j].first - row[j - 1].first, out);
+      }
+      WriteVarint(row[j].second, out);
+    }
+  }
+};
+
+}  // namespace her
+#endif  // HER_COMPRESSED_CSR_H_
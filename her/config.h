@@ -10,6 +10,22 @@ template <typename CoordinateT>
 using dense_vector_t = Eigen::Matrix<CoordinateT, Eigen::Dynamic, 1, Eigen::ColMajor>;
 
 using depth_t = uint16_t;
+
+using edge_label_id_t = uint16_t;
+
+// Edge labels along a path, it stands for the labels joined by spaces
+using edge_label_path_t = std::vector<edge_label_id_t>;
+
+struct EdgeLabelPathPairHash {
+  std::size_t operator()(
+      const std::pair<edge_label_path_t, edge_label_path_t>& pair) const {
+    std::size_t seed = boost::hash_range(pair.first.begin(), pair.first.end());
+
+    boost::hash_combine(
+        seed, boost::hash_range(pair.second.begin(), pair.second.end()));
+    return seed;
+  }
+};
 }  // namespace her
 
 template <class T1, class T2>
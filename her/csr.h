@@ -0,0 +1,110 @@
+#ifndef HER_CSR_H_
+#define HER_CSR_H_
+#include <cstddef>
+#include <vector>
+
+#include "her/compressed_csr.h"
+#include "her/memory_policy.h"
+#include "her/snapshot.h"
+
+namespace her {
+/**
+ * A read-only view of size contiguous elements, e.g. the out-neighbors of a
+ * vertex. It is a pointer and a length, so a loop over it is a plain loop
+ * over an array.
+ */
+template <typename T>
+class Span {
+ public:
+  Span() = default;
+
+  Span(const T* data, size_t size) : data_(data), size_(size) {}
+
+  const T* data() const { return data_; }
+
+  size_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+  const T* begin() const { return data_; }
+
+  const T* end() const { return data_ + size_; }
+
+  const T& operator[](size_t i) const { return data_[i]; }
+
+ private:
+  const T* data_{};
+  size_t size_{};
+};
+
+// An array of a CSR, owned under the large array policy or used in place
+template <typename T>
+using csr_array_t = CowArray<T, LargeArrayAllocator<T>>;
+
+/**
+ * The out-edges of a graph in compressed sparse row form, as separate arrays.
+ * The out-edges of vertex v are the edge indices [offsets[v], offsets[v + 1]),
+ * the i-th edge goes to neighbors[i] and carries edge_data[i]. Edges of a row
+ * keep the order they are added in. The arrays follow the large array policy,
+ * or are used in place from a snapshot until they are changed.
+ */
+template <typename VID_T, typename VDATA_T, typename EDATA_T>
+struct Csr {
+  csr_array_t<size_t> offsets{large_vector_t<size_t>{0}};
+  csr_array_t<VID_T> neighbors;
+  csr_array_t<EDATA_T> edge_data;
+  csr_array_t<VDATA_T> vertex_data;
+  // Only set when the edges of every row are grouped by their data: the
+  // groups of row v are [group_rows[v], group_rows[v + 1]), group i holds
+  // the edges [group_offsets[i], group_offsets[i + 1]) with data
+  // group_data[i]
+  csr_array_t<size_t> group_rows;
+  csr_array_t<size_t> group_offsets;
+  csr_array_t<EDATA_T> group_data;
+  // Only set when the rows are compressed, see Graph::CompressEdges, the
+  // arrays of the edges and the groups are empty then
+  CompressedRows<VID_T, EDATA_T> compressed;
+
+  size_t VertexNum() const { return vertex_data.size(); }
+
+  size_t EdgeNum() const { return neighbors.size(); }
+
+  size_t Degree(VID_T v) const { return offsets[v + 1] - offsets[v]; }
+
+  Span<VID_T> Neighbors(VID_T v) const {
+    return Span<VID_T>(neighbors.data() + offsets[v], Degree(v));
+  }
+
+  Span<EDATA_T> EdgeData(VID_T v) const {
+    return Span<EDATA_T>(edge_data.data() + offsets[v], Degree(v));
+  }
+
+  bool Grouped() const { return !group_rows.empty(); }
+
+  bool Compressed() const { return !compressed.empty(); }
+
+  void ClearGroups() {
+    group_rows = large_vector_t<size_t>();
+    group_offsets = large_vector_t<size_t>();
+    group_data = large_vector_t<EDATA_T>();
+  }
+};
+
+/**
+ * An out-edge, with copies of its target and data, so edges decoded from
+ * compressed rows look like edges of a CSR.
+ */
+template <typename VID_T, typename EDATA_T>
+struct CsrEdge {
+  CsrEdge() = default;
+
+  CsrEdge(VID_T src, VID_T dst, const EDATA_T& data)
+      : src(src), dst(dst), data(data) {}
+
+  VID_T src{};
+  VID_T dst{};
+  EDATA_T data{};
+};
+
+}  // namespace her
+#endif  // HER_CSR_H_
@@ -0,0 +1,226 @@
+#ifndef HER_CSR_BUILDER_H_
+#define HER_CSR_BUILDER_H_
+#include <algorithm>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+#include "her/worker_pool.h"
+
+namespace her {
+/**
+ * Builds the out-edges of a Csr with several threads.
+ *
+ * The vertices are split into buckets of consecutive ids. Edges are put into
+ * the bucket of their source as they are parsed, like the first pass of a
+ * radix sort, into chunks which are kept in file order. Every bucket is then
+ * counting sorted on its own: the out-degrees of its vertices are counted,
+ * their prefix sum gives the row offsets, and the edges are moved from the
+ * chunks straight into their rows. Buckets are released as soon as they are
+ * moved, so no merged edge list is ever built. Chunks are visited in file
+ * order, the edges of a row therefore keep the order of the edge file.
+ */
+template <typename VID_T, typename EDATA_T>
+class CsrBuilder {
+ public:
+  // Edges parsed from a block of the edge file, by the bucket of the source
+  struct Chunk {
+    std::vector<std::vector<std::pair<VID_T, VID_T>>> edges;
+    std::vector<std::vector<EDATA_T>> data;
+  };
+
+  CsrBuilder(size_t n_vertices, int parallelism) : n_vertices_(n_vertices) {
+    // More buckets than threads balance vertices of skewed degrees
+    size_t n_buckets = std::max<size_t>(4 * std::max(parallelism, 1), 1);
+
+    n_threads_ = std::max(parallelism, 1);
+    bucket_width_ = std::max<size_t>((n_vertices + n_buckets - 1) / n_buckets,
+                                     1);
+    n_buckets_ = (n_vertices + bucket_width_ - 1) / bucket_width_;
+  }
+
+  Chunk NewChunk() const {
+    Chunk chunk;
+
+    chunk.edges.resize(n_buckets_);
+    chunk.data.resize(n_buckets_);
+    return chunk;
+  }
+
+  void Add(Chunk& chunk, VID_T src, VID_T dst, const EDATA_T& data) const {
+    size_t bucket = src / bucket_width_;
+
+    chunk.edges[bucket].emplace_back(src, dst);
+    chunk.data[bucket].push_back(data);
+  }
+
+  static size_t EdgeNum(const Chunk& chunk) {
+    size_t n_edges = 0;
+
+    for (auto& edges : chunk.edges) {
+      n_edges += edges.size();
+    }
+    return n_edges;
+  }
+
+  /**
+   * Build the out-edges of csr from all chunks, the chunks are emptied. The
+   * vertex data is not touched, it is assigned by the caller.
+   */
+  template <typename CSR_T>
+  void Build(std::vector<Chunk>& chunks, CSR_T& csr) const {
+    auto& rowstart = csr.offsets.Mutable();
+    auto& column = csr.neighbors.Mutable();
+    auto& edge_data = csr.edge_data.Mutable();
+    std::vector<size_t> bucket_offsets(n_buckets_ + 1, 0);
+
+    rowstart.assign(n_vertices_ + 1, 0);
+
+    // The out-degree of v is counted at rowstart[v + 1], then summed up, so
+    // rowstart[v + 1] is the end of the row of v relative to the first edge
+    // of the bucket
+    ForEachBucket([&](size_t bucket) {
+      size_t v_begin = bucket * bucket_width_;
+      size_t v_end = std::min(v_begin + bucket_width_, n_vertices_);
+
+      for (auto& chunk : chunks) {
+        if (bucket < chunk.edges.size()) {
+          for (auto& e : chunk.edges[bucket]) {
+            rowstart[e.first + 1]++;
+          }
+        }
+      }
+      for (size_t v = v_begin + 1; v < v_end; v++) {
+        rowstart[v + 1] += rowstart[v];
+      }
+      bucket_offsets[bucket + 1] = rowstart[v_end];
+    });
+    for (size_t bucket = 0; bucket < n_buckets_; bucket++) {
+      bucket_offsets[bucket + 1] += bucket_offsets[bucket];
+    }
+
+    size_t n_edges = bucket_offsets[n_buckets_];
+
+    column.resize(n_edges);
+    edge_data.resize(n_edges);
+
+    ForEachBucket([&](size_t bucket) {
+      size_t v_begin = bucket * bucket_width_;
+      size_t v_end = std::min(v_begin + bucket_width_, n_vertices_);
+      size_t offset = bucket_offsets[bucket];
+      // The next free slot of the rows of the bucket
+      std::vector<size_t> pos(v_end - v_begin);
+
+      // rowstart[v_begin] belongs to the previous bucket
+      for (size_t v = v_begin; v < v_end; v++) {
+        pos[v - v_begin] = offset + (v == v_begin ? 0 : rowstart[v]);
+      }
+      for (auto& chunk : chunks) {
+        if (bucket >= chunk.edges.size()) {
+          continue;
+        }
+
+        auto& edges = chunk.edges[bucket];
+        auto& data = chunk.data[bucket];
+
+        for (size_t i = 0; i < edges.size(); i++) {
+          size_t slot = pos[edges[i].first - v_begin]++;
+
+          column[slot] = edges[i].second;
+          edge_data[slot] = data[i];
+        }
+        edges = std::vector<std::pair<VID_T, VID_T>>();
+        data = std::vector<EDATA_T>();
+      }
+      for (size_t v = v_begin; v < v_end; v++) {
+        rowstart[v + 1] = pos[v - v_begin];
+      }
+    });
+    chunks.clear();
+  }
+
+  /**
+   * Build compressed rows from all chunks instead of the arrays of a Csr,
+   * see CompressedRows, the chunks are emptied. Every bucket is counting
+   * sorted into a buffer of its own and coded right away, so the arrays of
+   * the whole graph are never built.
+   */
+  template <typename ROWS_T>
+  void BuildCompressed(std::vector<Chunk>& chunks, ROWS_T& rows) const {
+    rows.Build(n_vertices_, bucket_width_, static_cast<int>(n_threads_),
+               [&](size_t v_begin, size_t v_end, const auto& encode) {
+                 EncodeBucket(chunks, v_begin, v_end, encode);
+               });
+    chunks.clear();
+  }
+
+ private:
+  // Counting sort the edges of the bucket of [v_begin, v_end) into their
+  // rows, and call encode(v, row) for every row in order
+  template <typename ENCODE_T>
+  void EncodeBucket(std::vector<Chunk>& chunks, size_t v_begin, size_t v_end,
+                    const ENCODE_T& encode) const {
+    size_t bucket = v_begin / bucket_width_;
+    std::vector<size_t> row_ends(v_end - v_begin + 1, 0);
+
+    for (auto& chunk : chunks) {
+      if (bucket < chunk.edges.size()) {
+        for (auto& e : chunk.edges[bucket]) {
+          row_ends[e.first - v_begin + 1]++;
+        }
+      }
+    }
+    for (size_t i = 1; i < row_ends.size(); i++) {
+      row_ends[i] += row_ends[i - 1];
+    }
+
+    std::vector<std::pair<VID_T, EDATA_T>> edges(row_ends.back());
+    std::vector<size_t> pos(row_ends.begin(), row_ends.end() - 1);
+
+    for (auto& chunk : chunks) {
+      if (bucket >= chunk.edges.size()) {
+        continue;
+      }
+
+      auto& bucket_edges = chunk.edges[bucket];
+      auto& data = chunk.data[bucket];
+
+      for (size_t i = 0; i < bucket_edges.size(); i++) {
+        edges[pos[bucket_edges[i].first - v_begin]++] =
+            std::make_pair(bucket_edges[i].second, data[i]);
+      }
+      bucket_edges = std::vector<std::pair<VID_T, VID_T>>();
+      data = std::vector<EDATA_T>();
+    }
+
+    std::vector<std::pair<VID_T, EDATA_T>> row;
+
+    for (size_t v = v_begin; v < v_end; v++) {
+      row.assign(edges.begin() + row_ends[v - v_begin],
+                 edges.begin() + row_ends[v - v_begin + 1]);
+      encode(v, row);
+    }
+  }
+
+  // Run func(bucket) for all buckets, each bucket is taken by one thread
+  template <typename FUNC_T>
+  void ForEachBucket(const FUNC_T& func) const {
+    std::atomic<size_t> next_bucket(0);
+
+    ParallelFor(std::min(n_threads_, n_buckets_), [&](size_t) {
+      for (size_t bucket = next_bucket++; bucket < n_buckets_;
+           bucket = next_bucket++) {
+        func(bucket);
+      }
+    });
+  }
+
+  size_t n_vertices_;
+  size_t n_threads_;
+  size_t n_buckets_;
+  size_t bucket_width_;
+};
+
+}  // namespace her
+#endif  // HER_CSR_BUILDER_H_
@@ -7,8 +7,39 @@ DEFINE_string(gd_efile, "", "edge file of graph GD");
 DEFINE_string(gd_vfile, "", "vertex file of graph GD");
 DEFINE_string(g_efile, "", "edge file of graph G");
 DEFINE_string(g_vfile, "", "vertex file of graph G");
+DEFINE_string(oid_type, "int32",
+              "type of the vertex ids of the input files: int32, int64 or "
+              "string");
+DEFINE_string(reorder, "none",
+              "Renumber the vertices of GD and G after loading them, so that "
+              "close vertices get close ids: none, bfs, rcm or degree");
+DEFINE_bool(prune_g, false,
+            "Only keep the vertices of G reachable from a source entity of G, "
+            "with dense ids in their original order (only for apair)");
+DEFINE_int32(prune_depth, -1,
+             "With -prune_g, only keep the vertices within this many hops of "
+             "a source entity, -1 keeps all reachable vertices. APair recurses "
+             "deeper than -bfs_depth, so a bound may change its results");
+DEFINE_bool(compress_g, false,
+            "Keep the out-edges of G in compressed rows, sorted by target and "
+            "gap coded, snapshots keep them compressed");
+DEFINE_string(gd_traverse_edge_labels, "",
+              "Comma separated edge labels that the descendants and edge "
+              "label paths of GD follow, all edge labels if empty");
+DEFINE_string(g_traverse_edge_labels, "",
+              "Comma separated edge labels that the descendants and edge "
+              "label paths of G follow, all edge labels if empty");
+DEFINE_string(g_delta_file, "",
+              "Comma separated delta files applied to G in the given order, "
+              "after G is loaded or restored from a snapshot");
 DEFINE_string(synonym_file, "", "a file contains synonym and score");
 DEFINE_string(embedding_file, "", "pre-trained word embedding file");
+DEFINE_bool(embedding_sidecar, false,
+            "Load the word embedding from <embedding_file>.herbin if it is "
+            "up to date, otherwise write it after parsing the text file");
+DEFINE_bool(prune_embedding, false,
+            "Only keep word vectors of the words in the labels of GD and G, "
+            "the path file, the synonym file and the delta files");
 DEFINE_string(gd_slabel_file, "", "A file contains source labels");
 DEFINE_string(g_slabel_file, "", "A file contains source labels");
 DEFINE_string(out_prefix, "", "output prefix");
@@ -17,6 +48,33 @@ DEFINE_int32(bfs_depth, 3, "the depth of BFS used by function h_r");
 DEFINE_string(desc_file, "", "A file contains vertex descendants of G");
 DEFINE_string(path_file, "", "A file contains labels between v1 and v2 of G");
 DEFINE_string(vpair_sources_file, "", "A file contains starting ids of gd");
+DEFINE_string(snapshot_out, "",
+              "Write the prepared graphs, vectors and index to this file");
+DEFINE_string(snapshot_in, "",
+              "Restore the prepared state from a file written by "
+              "-snapshot_out instead of loading the input files");
+DEFINE_int32(stats_sources, 64,
+             "Source entities sampled for the mean descendant counts of the "
+             "graph statistics, 0 skips them");
+DEFINE_string(stats_file, "",
+              "Write the statistics of GD and G gathered at load time to this "
+              "file as JSON");
+DEFINE_bool(map_vertex_labels, false,
+            "Keep the lower-case vertex labels of plain vertex files in the "
+            "mapped files instead of copying them into memory");
+DEFINE_bool(share_node_memory, false,
+            "Load the input once per node and let the ranks of a node map "
+            "the prepared state from a snapshot in -node_snapshot_dir");
+DEFINE_string(node_snapshot_dir, "/dev/shm",
+              "A directory on a memory backed file system, used by "
+              "-share_node_memory");
+DEFINE_string(huge_pages, "none",
+              "Pages backing the large arrays (CSR, label vectors, embedding, "
+              "postings): none, transparent or explicit (MAP_HUGETLB, needs "
+              "reserved huge pages)");
+DEFINE_string(numa_policy, "local",
+              "Placement of the pages of the large arrays: local (first "
+              "touch) or interleave (round robin over all NUMA nodes)");
 DEFINE_int32(
     n_iter, 1,
     "Repeat -n_iter rounds evaluation to get a reliable timing result");
@@ -29,6 +87,6 @@ DEFINE_string(
     query_type, "",
     "query type: spair, spair_benchmark, vpair, vpair_benchmark, apair");
 
-DEFINE_int32(vertex_u, 0, "vertex u of graph GD");
-DEFINE_int32(vertex_v, 0, "vertex v of graph G");
+DEFINE_string(vertex_u, "0", "vertex u of graph GD");
+DEFINE_string(vertex_v, "0", "vertex v of graph G");
 }  // namespace her
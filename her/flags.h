@@ -7,8 +7,18 @@ DECLARE_string(gd_efile);
 DECLARE_string(gd_vfile);
 DECLARE_string(g_efile);
 DECLARE_string(g_vfile);
+DECLARE_string(oid_type);
+DECLARE_string(reorder);
+DECLARE_bool(prune_g);
+DECLARE_int32(prune_depth);
+DECLARE_bool(compress_g);
+DECLARE_string(gd_traverse_edge_labels);
+DECLARE_string(g_traverse_edge_labels);
+DECLARE_string(g_delta_file);
 DECLARE_string(synonym_file);
 DECLARE_string(embedding_file);
+DECLARE_bool(embedding_sidecar);
+DECLARE_bool(prune_embedding);
 DECLARE_string(gd_slabel_file);
 DECLARE_string(g_slabel_file);
 DECLARE_string(out_prefix);
@@ -18,6 +28,15 @@ DECLARE_int32(bfs_depth);
 DECLARE_string(desc_file);
 DECLARE_string(path_file);
 DECLARE_string(vpair_sources_file);
+DECLARE_string(snapshot_out);
+DECLARE_string(snapshot_in);
+DECLARE_int32(stats_sources);
+DECLARE_string(stats_file);
+DECLARE_bool(map_vertex_labels);
+DECLARE_bool(share_node_memory);
+DECLARE_string(node_snapshot_dir);
+DECLARE_string(huge_pages);
+DECLARE_string(numa_policy);
 DECLARE_int32(n_iter);
 DECLARE_bool(measure);
 
@@ -27,7 +46,7 @@ DECLARE_int32(k);
 
 DECLARE_string(query_type);
 
-DECLARE_int32(vertex_u);
-DECLARE_int32(vertex_v);
+DECLARE_string(vertex_u);
+DECLARE_string(vertex_v);
 }  // namespace her
 #endif  // HER_FLAGS_H_
@@ -1,68 +1,90 @@
 #ifndef HER_GRAPH_H_
 #define HER_GRAPH_H_
-#include <boost/graph/compressed_sparse_row_graph.hpp>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #include "glog/logging.h"
+#include "her/csr.h"
+#include "her/csr_builder.h"
+#include "her/graph_delta.h"
+#include "her/label_dictionary.h"
+#include "her/oid.h"
+#include "her/snapshot.h"
+#include "her/tokenizer.h"
 #include "her/vertex_map.h"
+#include "her/worker_pool.h"
 
 namespace her {
-enum class LoadStrategy { kOnlyIn, kOnlyOut, kBothOutIn };
+/**
+ * Only out-edges are loaded. In-edges are derived from them on demand, see
+ * Graph::InNeighbors.
+ */
+enum class LoadStrategy { kOnlyOut };
 
-template <typename VID_T, typename VDATA_T, typename EDATA_T,
-          LoadStrategy load_strategy>
-struct boost_graph;
+/**
+ * The vertex ids [begin, end). Iterating it yields the ids themselves.
+ */
+template <typename VID_T>
+class VertexRange {
+ public:
+  class iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = VID_T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const VID_T*;
+    using reference = VID_T;
 
-template <typename VID_T, typename VDATA_T, typename EDATA_T>
-struct boost_graph<VID_T, VDATA_T, EDATA_T, LoadStrategy::kOnlyOut> {
-  using type = boost::compressed_sparse_row_graph<boost::directedS, VDATA_T,
-                                                  EDATA_T, boost::no_property,
-                                                  VID_T, std::size_t>;
-};
+    iterator() = default;
 
-template <typename VID_T, typename VDATA_T, typename EDATA_T>
-struct boost_graph<VID_T, VDATA_T, EDATA_T, LoadStrategy::kBothOutIn> {
-  using type =
-      boost::compressed_sparse_row_graph<boost::bidirectionalS, VDATA_T,
-                                         EDATA_T, boost::no_property, VID_T,
-                                         std::size_t>;
-};
+    explicit iterator(VID_T v) : v_(v) {}
 
-template <typename BOOST_GRAPH>
-class VertexRange {
-  using graph_t = BOOST_GRAPH;
+    VID_T operator*() const { return v_; }
 
- public:
-  VertexRange() = default;
+    iterator& operator++() {
+      v_++;
+      return *this;
+    }
 
-  explicit VertexRange(
-      const std::pair<typename boost::graph_traits<graph_t>::vertex_iterator,
-                      typename boost::graph_traits<graph_t>::vertex_iterator>&
-          vertices)
-      : begin_(vertices.first), end_(vertices.second) {}
+    iterator operator++(int) {
+      auto it = *this;
 
-  explicit VertexRange(
-      const typename boost::graph_traits<graph_t>::vertex_iterator& begin,
-      const typename boost::graph_traits<graph_t>::vertex_iterator& end)
-      : begin_(begin), end_(end) {}
+      v_++;
+      return it;
+    }
 
-  typename boost::graph_traits<graph_t>::vertex_iterator begin() {
-    return begin_;
-  }
+    iterator operator+(size_t n) const { return iterator(v_ + n); }
 
-  typename boost::graph_traits<graph_t>::vertex_iterator end() { return end_; }
+    size_t operator-(const iterator& rhs) const { return v_ - rhs.v_; }
 
-  typename boost::graph_traits<graph_t>::vertex_iterator begin() const {
-    return begin_;
-  }
+    bool operator==(const iterator& rhs) const { return v_ == rhs.v_; }
 
-  typename boost::graph_traits<graph_t>::vertex_iterator end() const {
-    return end_;
-  }
+    bool operator!=(const iterator& rhs) const { return v_ != rhs.v_; }
+
+   private:
+    VID_T v_{};
+  };
+
+  VertexRange() = default;
+
+  VertexRange(VID_T begin, VID_T end) : begin_(begin), end_(end) {}
+
+  VertexRange(const iterator& begin, const iterator& end)
+      : begin_(*begin), end_(*end) {}
+
+  iterator begin() const { return iterator(begin_); }
+
+  iterator end() const { return iterator(end_); }
 
   size_t size() const { return end_ - begin_; }
 
-  std::vector<VertexRange<BOOST_GRAPH>> ToChunks(size_t n_chunks) {
-    std::vector<VertexRange<BOOST_GRAPH>> chunks;
+  std::vector<VertexRange<VID_T>> ToChunks(size_t n_chunks) {
+    std::vector<VertexRange<VID_T>> chunks;
     size_t size = end_ - begin_;
     size_t chunk_size = size / n_chunks;
 
@@ -83,49 +105,50 @@ class VertexRange {
   }
 
  private:
-  typename boost::graph_traits<graph_t>::vertex_iterator begin_;
-  typename boost::graph_traits<graph_t>::vertex_iterator end_;
+  VID_T begin_{};
+  VID_T end_{};
 };
 
 template <typename T, typename GRAPH_T>
 class VertexArray {
-  using boost_graph_t = typename GRAPH_T::boost_graph_t;
-  using vertex_t =
-      typename boost::graph_traits<boost_graph_t>::vertex_descriptor;
+  using vertex_t = typename GRAPH_T::vertex_t;
+  using vertex_range_t = typename GRAPH_T::vertex_range_t;
 
  public:
   VertexArray() = default;
 
-  explicit VertexArray(const VertexRange<boost_graph_t>& range)
+  explicit VertexArray(const vertex_range_t& range)
       : data_(range.size()), range_(range) {
-    fake_start_ = data_.data() - range_.begin().base();
+    fake_start_ = data_.data() - *range_.begin();
   }
 
-  VertexArray(const VertexRange<boost_graph_t>& range, const T& value)
+  VertexArray(const vertex_range_t& range, const T& value)
       : data_(range.size(), value), range_(range) {
-    fake_start_ = data_.data() - range_.begin().base();
+    fake_start_ = data_.data() - *range_.begin();
   }
 
-  void Init(const VertexRange<boost_graph_t>& range) {
+  void Init(const vertex_range_t& range) {
     data_.clear();
     data_.resize(range.size());
     range_ = range;
-    fake_start_ = data_.data() - range_.begin().base();
+    fake_start_ = data_.data() - *range_.begin();
   }
 
-  void Init(const VertexRange<boost_graph_t>& range, const T& value) {
+  void Init(const vertex_range_t& range, const T& value) {
     data_.clear();
     data_.resize(range.size(), value);
     range_ = range;
-    fake_start_ = data_.data() - range_.begin().base();
+    fake_start_ = data_.data() - *range_.begin();
   }
 
-  void SetValue(const VertexRange<boost_graph_t>& range, const T& value) {
-    std::fill_n(&data_[range.begin().base() - range_.begin().base()],
-                range.size(), value);
+  void SetValue(const vertex_range_t& range, const T& value) {
+    std::fill_n(&data_[*range.begin() - *range_.begin()], range.size(),
+                value);
   }
 
-  void SetValue(const T& value) { std::fill_n(data_, data_.size(), value); }
+  void SetValue(const T& value) {
+    std::fill_n(data_.begin(), data_.size(), value);
+  }
 
   inline T& operator[](const vertex_t& loc) { return fake_start_[loc]; }
 
@@ -133,14 +156,85 @@ class VertexArray {
     return fake_start_[loc];
   }
 
-  const VertexRange<boost_graph_t>& GetVertexRange() const { return range_; }
+  const vertex_range_t& GetVertexRange() const { return range_; }
 
  private:
-  VertexRange<boost_graph_t> range_;
+  vertex_range_t range_;
   std::vector<T> data_;
   T* fake_start_;
 };
 
+/**
+ * An iterator over the out-edges of a vertex. It either walks the neighbor
+ * and edge data arrays of the row of the vertex side by side, or decodes a
+ * compressed row edge by edge. Edges are returned by value, so they stay
+ * valid after the iterator moves on.
+ */
+template <typename VID_T, typename EDATA_T>
+class OutEdgeIterator {
+  using edge_t = CsrEdge<VID_T, EDATA_T>;
+  using cursor_t = CompressedRowCursor<VID_T, EDATA_T>;
+
+ public:
+  using iterator_category = std::input_iterator_tag;
+  using value_type = edge_t;
+  using difference_type = std::ptrdiff_t;
+  using pointer = void;
+  using reference = const edge_t;
+
+  OutEdgeIterator() = default;
+
+  OutEdgeIterator(VID_T src, const VID_T* dst, const EDATA_T* data)
+      : src_(src), dst_(dst), data_(data) {}
+
+  // The remaining edges of cursor
+  OutEdgeIterator(VID_T src, const cursor_t& cursor)
+      : src_(src), cursor_(cursor), remaining_(cursor.remaining()) {
+    cursor_.Next();
+  }
+
+  const edge_t operator*() const {
+    if (dst_ != nullptr) {
+      return edge_t(src_, *dst_, *data_);
+    }
+    return edge_t(src_, cursor_.dst(), cursor_.data());
+  }
+
+  OutEdgeIterator& operator++() {
+    if (dst_ != nullptr) {
+      dst_++;
+      data_++;
+    } else {
+      remaining_--;
+      cursor_.Next();
+    }
+    return *this;
+  }
+
+  OutEdgeIterator operator++(int) {
+    auto it = *this;
+
+    ++*this;
+    return it;
+  }
+
+  // A compressed row ends when no edge remains
+  bool operator==(const OutEdgeIterator& rhs) const {
+    return dst_ == rhs.dst_ && remaining_ == rhs.remaining_;
+  }
+
+  bool operator!=(const OutEdgeIterator& rhs) const { return !(*this == rhs); }
+
+ private:
+  VID_T src_{};
+  // The position in the arrays of an uncompressed row
+  const VID_T* dst_{};
+  const EDATA_T* data_{};
+  // The position in a compressed row
+  cursor_t cursor_;
+  size_t remaining_{};
+};
+
 template <typename EDGE_ITERATOR>
 class AdjList {
  public:
@@ -164,26 +258,36 @@ class Graph {
   using vid_t = VID_T;
   using vdata_t = VDATA_T;
   using edata_t = EDATA_T;
-  using boost_graph_t =
-      typename boost_graph<vid_t, vdata_t, edata_t, _load_strategy>::type;
-  using vertex_t =
-      typename boost::graph_traits<boost_graph_t>::vertex_descriptor;
-  using vertex_range_t = VertexRange<boost_graph_t>;
-  using edge_t = typename boost::graph_traits<boost_graph_t>::edge_descriptor;
+  using csr_t = Csr<vid_t, vdata_t, edata_t>;
+  using vertex_t = vid_t;
+  using vertex_range_t = VertexRange<vertex_t>;
+  using edge_t = CsrEdge<vertex_t, edata_t>;
   using vertex_map_t = VertexMap<oid_t, vid_t>;
+  using out_edge_iterator_t = OutEdgeIterator<vertex_t, edata_t>;
+  using update_t = GraphUpdate<vertex_t, vdata_t>;
 
   static constexpr LoadStrategy load_strategy = _load_strategy;
-  static_assert(std::is_same<vertex_t, vid_t>::value,
-                "Unexpected type assertion");
 
-  Graph() = default;
+  Graph()
+      : overlay_(std::make_shared<Overlay>()),
+        in_edges_(std::make_shared<InEdges>()) {}
 
-  Graph(std::shared_ptr<vertex_map_t> vm_ptr,
-        std::shared_ptr<boost_graph_t> graph)
-      : vertex_map_(vm_ptr), graph_(graph) {}
+  Graph(std::shared_ptr<vertex_map_t> vm_ptr, std::shared_ptr<csr_t> csr,
+        std::shared_ptr<LabelDictionary> label_dict,
+        std::shared_ptr<TokenTable> label_tokens,
+        std::shared_ptr<LabelDictionary> edge_label_dict,
+        std::shared_ptr<LabelDictionary> word_dict)
+      : vertex_map_(vm_ptr),
+        csr_(csr),
+        label_dict_(label_dict),
+        label_tokens_(label_tokens),
+        edge_label_dict_(edge_label_dict),
+        word_dict_(word_dict),
+        overlay_(std::make_shared<Overlay>()),
+        in_edges_(std::make_shared<InEdges>()) {}
 
   vertex_range_t Vertices() const {
-    return vertex_range_t(boost::vertices(*graph_));
+    return vertex_range_t(0, csr_->VertexNum());
   }
 
   bool GetId(const vertex_t& v, oid_t& oid) const {
@@ -201,58 +305,836 @@ class Graph {
   }
 
   const vdata_t& operator[](const vertex_t& v) const {
-    return graph_->operator[](v);
+    return csr_->vertex_data[v];
   }
 
-  vdata_t& operator[](const vertex_t& v) { return graph_->operator[](v); }
+  // The vertex data is copied first if it is used in place from a snapshot
+  void SetData(const vertex_t& v, const vdata_t& data) {
+    csr_->vertex_data.Mutable()[v] = data;
+  }
 
-  AdjList<typename boost_graph_t::out_edge_iterator> GetOutgoingAdjList(
-      const vertex_t v) const {
-    return AdjList<typename boost_graph_t::out_edge_iterator>(
-        boost::out_edges(v, *graph_));
+  /**
+   * The label of vertex v, only available when the vertex data is an id of
+   * the label dictionary.
+   */
+  boost::string_view GetLabel(const vertex_t& v) const {
+    return label_dict_->Get(csr_->vertex_data[v]);
   }
 
-  AdjList<typename boost_graph_t::in_edge_iterator> GetIncomingAdjList(
-      const vertex_t v) const {
-    return AdjList<typename boost_graph_t::in_edge_iterator>(
-        boost::in_edges(v, *graph_));
+  /**
+   * The pool of vertex labels, it may be shared by several graphs, so that a
+   * label has the same id in all of them.
+   */
+  const LabelDictionary& label_dict() const { return *label_dict_; }
+
+  std::shared_ptr<LabelDictionary> label_dict_ptr() const {
+    return label_dict_;
   }
 
-  vertex_t source(const edge_t& e) const { return boost::source(e, *graph_); }
+  /**
+   * The words of the label of vertex v, as ids of the word dictionary.
+   */
+  TokenTable::token_list_t GetTokens(const vertex_t& v) const {
+    return label_tokens_->Get(csr_->vertex_data[v]);
+  }
 
-  vertex_t target(const edge_t& e) const { return boost::target(e, *graph_); }
+  const TokenTable& label_tokens() const { return *label_tokens_; }
 
-  const edata_t& operator[](const edge_t& e) const {
-    return graph_->operator[](e);
+  std::shared_ptr<TokenTable> label_tokens_ptr() const {
+    return label_tokens_;
   }
 
-  edata_t& operator[](const edge_t& e) { return graph_->operator[](e); }
+  const LabelDictionary& word_dict() const { return *word_dict_; }
+
+  std::shared_ptr<LabelDictionary> word_dict_ptr() const { return word_dict_; }
+
+  /**
+   * The targets of the out-edges of v, in the order of its edges. The span is
+   * valid until the next delta is applied. Compressed rows have no spans, see
+   * CompressEdges.
+   */
+  Span<vertex_t> OutNeighbors(vertex_t v) const {
+    CHECK(!csr_->Compressed()) << "The out-edges are compressed";
+    auto* row = OverlayRow(v);
 
-  typename boost::graph_traits<boost_graph_t>::degree_size_type OutDegree(
-      vertex_t v) const {
-    return boost::out_degree(v, *graph_);
+    if (row != nullptr) {
+      return Span<vertex_t>(row->neighbors.data(), row->neighbors.size());
+    }
+    return csr_->Neighbors(v);
   }
 
-  typename boost::graph_traits<boost_graph_t>::degree_size_type InDegree(
-      vertex_t v) const {
-    return boost::in_degree(v, *graph_);
+  // The data of the out-edges of v, aligned with OutNeighbors(v)
+  Span<edata_t> OutEdgeData(vertex_t v) const {
+    CHECK(!csr_->Compressed()) << "The out-edges are compressed";
+    auto* row = OverlayRow(v);
+
+    if (row != nullptr) {
+      return Span<edata_t>(row->edge_data.data(), row->edge_data.size());
+    }
+    return csr_->EdgeData(v);
   }
 
+  AdjList<out_edge_iterator_t> GetOutgoingAdjList(const vertex_t v) const {
+    if (csr_->Compressed()) {
+      auto cursor = csr_->compressed.Row(v);
+
+      return AdjList<out_edge_iterator_t>(std::make_pair(
+          out_edge_iterator_t(v, cursor),
+          out_edge_iterator_t(v, CompressedRowCursor<vid_t, edata_t>())));
+    }
+
+    auto neighbors = OutNeighbors(v);
+    auto edge_data = OutEdgeData(v);
+
+    return AdjList<out_edge_iterator_t>(std::make_pair(
+        out_edge_iterator_t(v, neighbors.begin(), edge_data.begin()),
+        out_edge_iterator_t(v, neighbors.end(), edge_data.end())));
+  }
+
+  /**
+   * Call func(target, data) for the out-edges of v in order, only for those
+   * whose data is flagged by labels if labels is not empty, until func
+   * returns false. Data beyond labels is not flagged. If the rows are grouped
+   * by GroupEdgesByLabel, the edges of unflagged groups are skipped as a
+   * whole. Compressed rows are decoded on the fly. false is returned if
+   * func stopped the visit.
+   */
+  template <typename FUNC_T>
+  bool VisitOutEdges(vertex_t v, const std::vector<bool>& labels,
+                     const FUNC_T& func) const {
+    auto flagged = [&labels](edata_t data) {
+      return labels.empty() || (data < labels.size() && labels[data]);
+    };
+
+    if (csr_->Compressed()) {
+      auto cursor = csr_->compressed.Row(v);
+
+      while (cursor.Next()) {
+        if (flagged(cursor.data()) && !func(cursor.dst(), cursor.data())) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    if (!labels.empty() && csr_->Grouped() && OverlayRow(v) == nullptr) {
+      for (size_t i = csr_->group_rows[v]; i < csr_->group_rows[v + 1]; i++) {
+        if (!flagged(csr_->group_data[i])) {
+          continue;
+        }
+        for (size_t j = csr_->group_offsets[i]; j < csr_->group_offsets[i + 1];
+             j++) {
+          if (!func(csr_->neighbors[j], csr_->edge_data[j])) {
+            return false;
+          }
+        }
+      }
+      return true;
+    }
+
+    auto neighbors = OutNeighbors(v);
+    auto edge_data = OutEdgeData(v);
+
+    for (size_t i = 0; i < neighbors.size(); i++) {
+      if (flagged(edge_data[i]) && !func(neighbors[i], edge_data[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  vertex_t source(const edge_t& e) const { return e.src; }
+
+  vertex_t target(const edge_t& e) const { return e.dst; }
+
+  const edata_t& operator[](const edge_t& e) const { return e.data; }
+
+  /**
+   * The label of edge e, only available when the edge data is an id of the
+   * edge label table.
+   */
+  boost::string_view GetEdgeLabel(const edge_t& e) const {
+    return edge_label_dict_->Get(e.data);
+  }
+
+  const LabelDictionary& edge_label_dict() const { return *edge_label_dict_; }
+
+  std::shared_ptr<LabelDictionary> edge_label_dict_ptr() const {
+    return edge_label_dict_;
+  }
+
+  size_t OutDegree(vertex_t v) const {
+    auto* row = OverlayRow(v);
+
+    if (row != nullptr) {
+      return row->neighbors.size();
+    }
+    return csr_->Compressed() ? csr_->compressed.Degree(v) : csr_->Degree(v);
+  }
+
+  /**
+   * Build the in-edges from the out-edges by parallelism threads, unless they
+   * are built already. In-edges are only built when a feature needs the
+   * predecessors of vertices, so other runs do not pay for them. They are
+   * shared by copies of the graph, and dropped when a delta or Compact
+   * changes the graph.
+   */
+  void BuildInEdges(int parallelism) const {
+    auto& in_edges = *in_edges_;
+
+    if (in_edges.built.load(std::memory_order_acquire)) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(in_edges.mutex);
+
+    if (in_edges.built.load(std::memory_order_relaxed)) {
+      return;
+    }
+
+    // The sources are split into ranges in id order, and the chunks of the
+    // ranges are kept in that order, so the in-edges of a vertex are ordered
+    // by source
+    size_t n_vertices = csr_->VertexNum();
+    size_t n_chunks = std::max(parallelism, 1);
+    size_t chunk_size = (n_vertices + n_chunks - 1) / n_chunks;
+    CsrBuilder<vertex_t, edata_t> builder(n_vertices, parallelism);
+    std::vector<typename CsrBuilder<vertex_t, edata_t>::Chunk> chunks(
+        n_chunks);
+
+    ParallelFor(n_chunks, [&](size_t i) {
+      size_t begin = std::min(i * chunk_size, n_vertices);
+      size_t end = std::min(begin + chunk_size, n_vertices);
+      auto& chunk = chunks[i];
+
+      chunk = builder.NewChunk();
+      for (vertex_t u = begin; u < end; u++) {
+        VisitOutEdges(u, {}, [&](vertex_t v, edata_t data) {
+          builder.Add(chunk, v, u, data);
+          return true;
+        });
+      }
+    });
+    builder.Build(chunks, in_edges.csr);
+    in_edges.built.store(true, std::memory_order_release);
+  }
+
+  /**
+   * The sources of the in-edges of v, ordered by source. Parallel edges keep
+   * the order they have among the out-edges of their source. The in-edges are
+   * built by one thread on the first call, unless BuildInEdges is called
+   * before. The span is valid until the next delta is applied.
+   */
+  Span<vertex_t> InNeighbors(vertex_t v) const {
+    BuildInEdges(1);
+    return in_edges_->csr.Neighbors(v);
+  }
+
+  // The data of the in-edges of v, aligned with InNeighbors(v)
+  Span<edata_t> InEdgeData(vertex_t v) const {
+    BuildInEdges(1);
+    return in_edges_->csr.EdgeData(v);
+  }
+
+  size_t InDegree(vertex_t v) const {
+    BuildInEdges(1);
+    return in_edges_->csr.Degree(v);
+  }
+
+  // The first out-edge from u to v
   bool edge(vertex_t u, vertex_t v, edge_t& edge) const {
-    auto pair = boost::edge(u, v, *graph_);
+    if (csr_->Compressed()) {
+      edata_t data;
 
-    edge = pair.first;
-    return pair.second;
+      if (!csr_->compressed.Find(u, v, data)) {
+        return false;
+      }
+      edge = edge_t(u, v, data);
+      return true;
+    }
+    for (auto& e : GetOutgoingAdjList(u)) {
+      if (target(e) == v) {
+        edge = e;
+        return true;
+      }
+    }
+    return false;
   }
 
   std::shared_ptr<vertex_map_t> vertex_map() { return vertex_map_; }
 
+  // A removed vertex keeps its id, but it has no edges and no oid
+  bool IsRemoved(vertex_t v) const { return vertex_map_->IsRemoved(v); }
+
+  /**
+   * Apply the changes of delta in place. The CSR is not rebuilt: the out-edges
+   * of every touched vertex are copied to a row of an overlay, where edges are
+   * added and removed. Added vertices get the next ids, new labels are added
+   * to the label pool without changing the ids of other labels. Edges and
+   * relabeling cost time in the number of changes, but removing vertices
+   * takes one pass over all edges to drop the edges into them.
+   */
+  update_t ApplyDelta(const GraphDelta<oid_t>& delta) {
+    using delta_t = GraphDelta<oid_t>;
+    update_t update;
+
+    CHECK(!csr_->Compressed())
+        << "Deltas can not be applied to a graph with compressed edges";
+    in_edges_->Reset();
+    // Touched rows are not grouped, and added vertices have no groups
+    csr_->ClearGroups();
+
+    for (auto& change : delta.changes()) {
+      vertex_t src, dst;
+
+      if (change.op == delta_t::Op::kAddVertex) {
+        auto label = label_dict_->Intern(change.label);
+
+        if (!vertex_map_->GetLid(change.src, src)) {
+          CHECK(vertex_map_->AddVertex(change.src, src));
+          CHECK_EQ(src, csr_->VertexNum());
+          csr_->vertex_data.Mutable().push_back(label);
+          // Added vertices have no edges in the CSR
+          csr_->offsets.Mutable().push_back(csr_->offsets.back());
+          update.n_added_vertices++;
+        }
+        Touch(src, update);
+        if (csr_->vertex_data[src] != label) {
+          csr_->vertex_data.Mutable()[src] = label;
+        }
+      } else if (change.op == delta_t::Op::kRemoveVertex) {
+        CHECK(vertex_map_->GetLid(change.src, src))
+            << "Missing vertex " << change.src << " to remove";
+
+        auto& row = Touch(src, update);
+
+        update.n_removed_edges += row.neighbors.size();
+        row = Row();
+        vertex_map_->RemoveVertex(change.src, src);
+        update.n_removed_vertices++;
+      } else if (change.op == delta_t::Op::kAddEdge) {
+        auto label = edge_label_dict_->Intern(change.label);
+
+        CHECK(label <= std::numeric_limits<edata_t>::max())
+            << "Too many distinct edge labels";
+        CHECK(vertex_map_->GetLid(change.src, src))
+            << "Missing src vertex " << change.src << " of an added edge";
+        CHECK(vertex_map_->GetLid(change.dst, dst))
+            << "Missing dst vertex " << change.dst << " of an added edge";
+
+        auto& row = Touch(src, update);
+
+        row.neighbors.push_back(dst);
+        row.edge_data.push_back(label);
+        update.n_added_edges++;
+      } else {
+        label_id_t label = 0;
+        bool any_label = change.label.empty();
+
+        CHECK(vertex_map_->GetLid(change.src, src))
+            << "Missing src vertex " << change.src << " of a removed edge";
+        CHECK(vertex_map_->GetLid(change.dst, dst))
+            << "Missing dst vertex " << change.dst << " of a removed edge";
+        if (!any_label && !edge_label_dict_->Find(change.label, label)) {
+          continue;
+        }
+        update.n_removed_edges += EraseEdges(
+            Touch(src, update), [&](vertex_t v, const edata_t& data) {
+              return v == dst && (any_label || data == label);
+            });
+      }
+    }
+
+    if (update.n_removed_vertices > 0) {
+      for (vertex_t u = 0; u < csr_->VertexNum(); u++) {
+        auto neighbors = OutNeighbors(u);
+
+        if (std::any_of(neighbors.begin(), neighbors.end(),
+                        [this](vertex_t v) { return IsRemoved(v); })) {
+          update.n_removed_edges +=
+              EraseEdges(Touch(u, update), [this](vertex_t v, const edata_t&) {
+                return IsRemoved(v);
+              });
+        }
+      }
+    }
+
+    label_tokens_->Tokenize(*label_dict_, *word_dict_);
+    return update;
+  }
+
+  /**
+   * Keep only the vertices flagged by keep and the edges between them, in
+   * place. Kept vertices get dense ids in their original order and the
+   * out-edges of a vertex keep their order, so traversals visit the kept
+   * vertices as before. The new id of every kept vertex is returned, indexed
+   * by its old id.
+   */
+  std::vector<vertex_t> Compact(const std::vector<bool>& keep,
+                                int parallelism) {
+    CHECK(overlay_->rows.empty())
+        << "A graph changed by deltas can not be compacted";
+    CHECK(!csr_->Compressed())
+        << "A graph with compressed edges can not be compacted";
+    in_edges_->Reset();
+    size_t n_vertices = csr_->VertexNum();
+    std::vector<vertex_t> new_ids(n_vertices);
+    typename OidTraits<oid_t>::list_t oids;
+    csr_t compacted;
+    auto& offsets = compacted.offsets.Mutable();
+    auto& neighbors = compacted.neighbors.Mutable();
+    auto& edge_data = compacted.edge_data.Mutable();
+    auto& vertex_data = compacted.vertex_data.Mutable();
+
+    CHECK_EQ(keep.size(), n_vertices);
+    for (vertex_t v = 0; v < n_vertices; v++) {
+      if (keep[v]) {
+        new_ids[v] = oids.size();
+        oids.push_back(GetId(v));
+      }
+    }
+    for (vertex_t v = 0; v < n_vertices; v++) {
+      if (!keep[v]) {
+        continue;
+      }
+
+      auto row_neighbors = csr_->Neighbors(v);
+      auto row_edge_data = csr_->EdgeData(v);
+
+      vertex_data.push_back(csr_->vertex_data[v]);
+      for (size_t i = 0; i < row_neighbors.size(); i++) {
+        if (keep[row_neighbors[i]]) {
+          neighbors.push_back(new_ids[row_neighbors[i]]);
+          edge_data.push_back(row_edge_data[i]);
+        }
+      }
+      offsets.push_back(neighbors.size());
+    }
+    // Swapped in place, so copies of the graph see the compacted CSR as well
+    std::swap(*csr_, compacted);
+
+    oid_t duplicate;
+
+    *vertex_map_ = vertex_map_t();
+    CHECK(vertex_map_->BulkBuild(std::move(oids), parallelism, duplicate));
+    overlay_->touched.clear();
+    return new_ids;
+  }
+
+  /**
+   * Give every vertex v the id new_ids[v] in place, new_ids has to be a
+   * permutation of the ids. The out-edges of a vertex keep their order and
+   * get the new ids of their targets, the vertex map maps the oids to the new
+   * ids. The rows are moved by parallelism threads.
+   */
+  void Permute(const std::vector<vertex_t>& new_ids, int parallelism) {
+    CHECK(overlay_->rows.empty())
+        << "A graph changed by deltas can not be permuted";
+    CHECK(!csr_->Compressed())
+        << "A graph with compressed edges can not be permuted";
+    in_edges_->Reset();
+    size_t n_vertices = csr_->VertexNum();
+    // The old id of every new id
+    std::vector<vertex_t> order(n_vertices);
+    typename OidTraits<oid_t>::list_t oids;
+    csr_t permuted;
+    auto& offsets = permuted.offsets.Mutable();
+    auto& neighbors = permuted.neighbors.Mutable();
+    auto& edge_data = permuted.edge_data.Mutable();
+    auto& vertex_data = permuted.vertex_data.Mutable();
+
+    CHECK_EQ(new_ids.size(), n_vertices);
+    for (vertex_t v = 0; v < n_vertices; v++) {
+      order[new_ids[v]] = v;
+    }
+    offsets.resize(n_vertices + 1);
+    vertex_data.resize(n_vertices);
+    for (size_t w = 0; w < n_vertices; w++) {
+      oids.push_back(GetId(order[w]));
+      vertex_data[w] = csr_->vertex_data[order[w]];
+      offsets[w + 1] = offsets[w] + csr_->Degree(order[w]);
+    }
+    neighbors.resize(csr_->EdgeNum());
+    edge_data.resize(csr_->EdgeNum());
+
+    size_t n_chunks = std::max(parallelism, 1);
+    size_t chunk_size = (n_vertices + n_chunks - 1) / n_chunks;
+
+    ParallelFor(n_chunks, [&](size_t i) {
+      size_t begin = std::min(i * chunk_size, n_vertices);
+      size_t end = std::min(begin + chunk_size, n_vertices);
+
+      for (size_t w = begin; w < end; w++) {
+        auto row_neighbors = csr_->Neighbors(order[w]);
+        auto row_edge_data = csr_->EdgeData(order[w]);
+        size_t offset = offsets[w];
+
+        for (size_t j = 0; j < row_neighbors.size(); j++) {
+          neighbors[offset + j] = new_ids[row_neighbors[j]];
+        }
+        std::copy(row_edge_data.begin(), row_edge_data.end(),
+                  edge_data.begin() + offset);
+      }
+    });
+    // Swapped in place, so copies of the graph see the new ids as well
+    std::swap(*csr_, permuted);
+
+    oid_t duplicate;
+
+    *vertex_map_ = vertex_map_t();
+    CHECK(vertex_map_->BulkBuild(std::move(oids), parallelism, duplicate));
+  }
+
+  /**
+   * Order the out-edges of every vertex by their data, stably, and record
+   * the groups of edges with equal data, so VisitOutEdges skips the groups
+   * of edge labels it does not follow. The rows are grouped in place by
+   * parallelism threads. Traversals following all edges visit them in the
+   * grouped order afterwards. The overlay of deltas applied before is merged
+   * into the CSR first. The groups are dropped by the next delta, Compact or
+   * Permute.
+   */
+  void GroupEdgesByLabel(int parallelism) {
+    CHECK(!csr_->Compressed())
+        << "A graph with compressed edges can not be grouped";
+    in_edges_->Reset();
+    FoldOverlay();
+
+    auto& csr = *csr_;
+    size_t n_vertices = csr.VertexNum();
+    size_t n_chunks = std::max(parallelism, 1);
+    size_t chunk_size = (n_vertices + n_chunks - 1) / n_chunks;
+    auto for_each_chunk = [&](const auto& f) {
+      ParallelFor(n_chunks, [&](size_t i) {
+        size_t begin = std::min(i * chunk_size, n_vertices);
+
+        f(begin, std::min(begin + chunk_size, n_vertices));
+      });
+    };
+
+    // Sort the rows and count their groups into group_rows[v + 1], the edges
+    // are copied first if they are used in place from a snapshot
+    auto& neighbors = csr.neighbors.Mutable();
+    auto& edge_data = csr.edge_data.Mutable();
+    large_vector_t<size_t> group_rows(n_vertices + 1, 0);
+
+    for_each_chunk([&](size_t begin, size_t end) {
+      std::vector<std::pair<edata_t, vertex_t>> row;
+
+      for (size_t v = begin; v < end; v++) {
+        size_t offset = csr.offsets[v];
+        size_t n_groups = 0;
+
+        row.clear();
+        for (size_t j = offset; j < csr.offsets[v + 1]; j++) {
+          row.emplace_back(csr.edge_data[j], csr.neighbors[j]);
+        }
+        std::stable_sort(row.begin(), row.end(),
+                         [](const std::pair<edata_t, vertex_t>& a,
+                            const std::pair<edata_t, vertex_t>& b) {
+                           return a.first < b.first;
+                         });
+        for (size_t j = 0; j < row.size(); j++) {
+          edge_data[offset + j] = row[j].first;
+          neighbors[offset + j] = row[j].second;
+          if (j == 0 || row[j].first != row[j - 1].first) {
+            n_groups++;
+          }
+        }
+        group_rows[v + 1] = n_groups;
+      }
+    });
+    for (size_t v = 0; v < n_vertices; v++) {
+      group_rows[v + 1] += group_rows[v];
+    }
+
+    // Groups partition the edge array, a group ends where the next begins
+    large_vector_t<size_t> group_offsets(group_rows.back() + 1);
+    large_vector_t<edata_t> group_data(group_rows.back());
+
+    group_offsets.back() = csr.EdgeNum();
+    for_each_chunk([&](size_t begin, size_t end) {
+      for (size_t v = begin; v < end; v++) {
+        size_t group = group_rows[v];
+
+        for (size_t j = csr.offsets[v]; j < csr.offsets[v + 1]; j++) {
+          if (j == csr.offsets[v] || csr.edge_data[j] != csr.edge_data[j - 1]) {
+            group_offsets[group] = j;
+            group_data[group] = csr.edge_data[j];
+            group++;
+          }
+        }
+      }
+    });
+    csr.group_rows = std::move(group_rows);
+    csr.group_offsets = std::move(group_offsets);
+    csr.group_data = std::move(group_data);
+  }
+
+  /**
+   * Replace the arrays of the out-edges by compressed rows, see
+   * CompressedRows, built by parallelism threads. The rows are sorted by
+   * target, parallel edges keep their order, so traversals visit the
+   * neighbors of a vertex in id order afterwards. The overlay of deltas
+   * applied before is merged first, label groups are dropped and listed
+   * labels are filtered edge by edge. Compressed edges are final: later
+   * deltas, Compact, Permute and grouping are not supported.
+   */
+  void CompressEdges(int parallelism) {
+    if (csr_->Compressed()) {
+      return;
+    }
+    in_edges_->Reset();
+    FoldOverlay();
+    csr_->compressed.Build(*csr_, parallelism);
+    csr_->offsets = large_vector_t<size_t>();
+    csr_->neighbors = large_vector_t<vid_t>();
+    csr_->edge_data = large_vector_t<edata_t>();
+    csr_->ClearGroups();
+  }
+
+  bool EdgesCompressed() const { return csr_->Compressed(); }
+
+  /**
+   * The bytes taken by the out-edges, their offsets and their groups, either
+   * in arrays or compressed.
+   */
+  size_t EdgeBytes() const {
+    auto& csr = *csr_;
+
+    return csr.offsets.size() * sizeof(size_t) +
+           csr.neighbors.size() * sizeof(vid_t) +
+           csr.edge_data.size() * sizeof(edata_t) +
+           (csr.group_rows.size() + csr.group_offsets.size()) *
+               sizeof(size_t) +
+           csr.group_data.size() * sizeof(edata_t) + csr.compressed.Bytes();
+  }
+
+  /**
+   * Write the vertex map, vertex data and the CSR arrays with edge data and
+   * label groups, or the compressed rows, so that restoring a snapshot does
+   * not need to sort, group or compress edges again. The label pool, the
+   * edge label table and the word dictionary may be shared by several
+   * graphs, so they are not written here.
+   */
+  void Serialize(SnapshotWriter& writer) const {
+    vertex_map_->Serialize(writer);
+    writer.WriteVector(csr_->vertex_data);
+    // Compressed rows have no overlay, deltas are not applied to them
+    if (overlay_->rows.empty()) {
+      writer.WriteVector(csr_->offsets);
+      writer.WriteVector(csr_->neighbors);
+      writer.WriteVector(csr_->edge_data);
+      writer.WriteVector(csr_->group_rows);
+      writer.WriteVector(csr_->group_offsets);
+      writer.WriteVector(csr_->group_data);
+      writer.WriteVector(csr_->compressed.offsets);
+      writer.WriteVector(csr_->compressed.codes);
+      return;
+    }
+
+    // The overlay is merged, so a restored graph is a plain CSR again, rows
+    // with an overlay are never grouped
+    auto merged = MergeOverlay();
+
+    writer.WriteVector(merged.offsets);
+    writer.WriteVector(merged.neighbors);
+    writer.WriteVector(merged.edge_data);
+    writer.WriteVector(merged.group_rows);
+    writer.WriteVector(merged.group_offsets);
+    writer.WriteVector(merged.group_data);
+    writer.WriteVector(merged.compressed.offsets);
+    writer.WriteVector(merged.compressed.codes);
+  }
+
+  // The CSR and the vertex map are used in place from the snapshot, an array
+  // is copied once the graph changes it
+  void Deserialize(SnapshotReader& reader,
+                   std::shared_ptr<LabelDictionary> label_dict,
+                   std::shared_ptr<TokenTable> label_tokens,
+                   std::shared_ptr<LabelDictionary> edge_label_dict,
+                   std::shared_ptr<LabelDictionary> word_dict) {
+    vertex_map_ = std::make_shared<vertex_map_t>();
+    csr_ = std::make_shared<csr_t>();
+    label_dict_ = label_dict;
+    label_tokens_ = label_tokens;
+    edge_label_dict_ = edge_label_dict;
+    word_dict_ = word_dict;
+    overlay_ = std::make_shared<Overlay>();
+    in_edges_ = std::make_shared<InEdges>();
+    vertex_map_->Deserialize(reader);
+    reader.ReadVector(csr_->vertex_data);
+    reader.ReadVector(csr_->offsets);
+    reader.ReadVector(csr_->neighbors);
+    reader.ReadVector(csr_->edge_data);
+    reader.ReadVector(csr_->group_rows);
+    reader.ReadVector(csr_->group_offsets);
+    reader.ReadVector(csr_->group_data);
+    reader.ReadVector(csr_->compressed.offsets);
+    reader.ReadVector(csr_->compressed.codes);
+
+    auto nvnum = vertex_map_->TotalVertexNum();
+
+    CHECK_EQ(csr_->vertex_data.size(), nvnum) << "Corrupted snapshot";
+    if (csr_->Compressed()) {
+      CHECK_EQ(csr_->compressed.offsets.size(), nvnum + 1)
+          << "Corrupted snapshot";
+      CHECK_EQ(csr_->compressed.offsets.back(), csr_->compressed.codes.size())
+          << "Corrupted snapshot";
+      CHECK(csr_->offsets.empty() && csr_->neighbors.empty() &&
+            !csr_->Grouped())
+          << "Corrupted snapshot";
+      return;
+    }
+    CHECK_EQ(csr_->offsets.size(), nvnum + 1) << "Corrupted snapshot";
+    CHECK_EQ(csr_->offsets.back(), csr_->neighbors.size())
+        << "Corrupted snapshot";
+    CHECK_EQ(csr_->neighbors.size(), csr_->edge_data.size())
+        << "Corrupted snapshot";
+    if (csr_->Grouped()) {
+      CHECK_EQ(csr_->group_rows.size(), nvnum + 1) << "Corrupted snapshot";
+      CHECK_EQ(csr_->group_offsets.size(), csr_->group_rows.back() + 1)
+          << "Corrupted snapshot";
+      CHECK_EQ(csr_->group_data.size(), csr_->group_rows.back())
+          << "Corrupted snapshot";
+    }
+  }
+
  private:
+  // The out-edges of a vertex touched by deltas, in the form of a CSR row
+  struct Row {
+    std::vector<vertex_t> neighbors;
+    std::vector<edata_t> edge_data;
+  };
+
+  /**
+   * The rows of the vertices touched by deltas. It is shared by copies of the
+   * graph, like the CSR itself.
+   */
+  struct Overlay {
+    std::vector<bool> touched;
+    std::unordered_map<vertex_t, Row> rows;
+  };
+
+  // The in-edges, built once by the first BuildInEdges
+  struct InEdges {
+    // Drop the in-edges, the next BuildInEdges builds them again
+    void Reset() {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      csr = csr_t();
+      built.store(false, std::memory_order_release);
+    }
+
+    std::mutex mutex;
+    std::atomic<bool> built{false};
+    csr_t csr;
+  };
+
+  // The out-edges of the CSR with the rows of the overlay in place, without
+  // vertex data
+  csr_t MergeOverlay() const {
+    csr_t merged;
+    auto& offsets = merged.offsets.Mutable();
+    auto& neighbors = merged.neighbors.Mutable();
+    auto& edge_data = merged.edge_data.Mutable();
+
+    for (auto v : Vertices()) {
+      auto row_neighbors = OutNeighbors(v);
+      auto row_edge_data = OutEdgeData(v);
+
+      neighbors.insert(neighbors.end(), row_neighbors.begin(),
+                       row_neighbors.end());
+      edge_data.insert(edge_data.end(), row_edge_data.begin(),
+                       row_edge_data.end());
+      offsets.push_back(neighbors.size());
+    }
+    return merged;
+  }
+
+  // Merge the overlay into the CSR in place, so copies see it as well
+  void FoldOverlay() {
+    if (overlay_->rows.empty()) {
+      return;
+    }
+
+    auto merged = MergeOverlay();
+
+    merged.vertex_data.swap(csr_->vertex_data);
+    std::swap(*csr_, merged);
+    overlay_->rows.clear();
+    overlay_->touched.clear();
+  }
+
+  // The overlay row of v, or nullptr if v is not touched by a delta
+  const Row* OverlayRow(vertex_t v) const {
+    auto& touched = overlay_->touched;
+
+    if (v >= touched.size() || !touched[v]) {
+      return nullptr;
+    }
+    return &overlay_->rows.find(v)->second;
+  }
+
+  /**
+   * Copy the out-edges of v to the overlay if they are not there yet, and
+   * record the state of v before the delta. The overlay row is returned.
+   */
+  Row& Touch(vertex_t v, update_t& update) {
+    auto& touched = overlay_->touched;
+
+    if (v < touched.size() && touched[v]) {
+      return overlay_->rows[v];
+    }
+
+    auto neighbors = csr_->Neighbors(v);
+    auto edge_data = csr_->EdgeData(v);
+    Row row;
+
+    row.neighbors.assign(neighbors.begin(), neighbors.end());
+    row.edge_data.assign(edge_data.begin(), edge_data.end());
+    update.vertices.push_back(v);
+    update.old_labels.push_back(csr_->vertex_data[v]);
+    update.had_out_edges.push_back(!neighbors.empty());
+    if (touched.size() <= v) {
+      touched.resize(csr_->VertexNum(), false);
+    }
+    touched[v] = true;
+    return overlay_->rows[v] = std::move(row);
+  }
+
+  /**
+   * Erase the edges of row for which pred(target, data) holds, the order of
+   * the others is kept. The number of erased edges is returned.
+   */
+  template <typename PRED_T>
+  static size_t EraseEdges(Row& row, const PRED_T& pred) {
+    size_t n_edges = row.neighbors.size();
+    size_t n_kept = 0;
+
+    for (size_t i = 0; i < n_edges; i++) {
+      if (!pred(row.neighbors[i], row.edge_data[i])) {
+        row.neighbors[n_kept] = row.neighbors[i];
+        row.edge_data[n_kept] = row.edge_data[i];
+        n_kept++;
+      }
+    }
+    row.neighbors.resize(n_kept);
+    row.edge_data.resize(n_kept);
+    return n_edges - n_kept;
+  }
+
   std::shared_ptr<vertex_map_t> vertex_map_;
-  std::shared_ptr<boost_graph_t> graph_;
+  std::shared_ptr<csr_t> csr_;
+  std::shared_ptr<LabelDictionary> label_dict_;
+  std::shared_ptr<TokenTable> label_tokens_;
+  std::shared_ptr<LabelDictionary> edge_label_dict_;
+  std::shared_ptr<LabelDictionary> word_dict_;
+  std::shared_ptr<Overlay> overlay_;
+  std::shared_ptr<InEdges> in_edges_;
 };
 
-using EmptyType = boost::no_property;
+struct EmptyType {};
 
 }  // namespace her
 #endif  // HER_GRAPH_H_
@@ -0,0 +1,103 @@
+#ifndef HER_GRAPH_DELTA_H_
+#define HER_GRAPH_DELTA_H_
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+#include "glog/logging.h"
+#include "her/input_file.h"
+#include "her/tokenizer.h"
+
+namespace her {
+/**
+ * Changes to a graph, read from a delta file. Each line is one change, blank
+ * lines and lines starting with '#' are skipped:
+ *
+ *   +v <oid> <label>            add a vertex, or relabel an existing one
+ *   -v <oid>                    remove a vertex and all of its edges
+ *   +e <src> <dst> <label>      add an edge
+ *   -e <src> <dst> [<label>]    remove the edges from src to dst, only those
+ *                               with the label if it is given
+ *
+ * Labels are trimmed and lower-cased like those of the vertex and edge
+ * files. Changes are applied in the order of the file.
+ */
+template <typename OID_T>
+class GraphDelta {
+ public:
+  enum class Op { kAddVertex, kRemoveVertex, kAddEdge, kRemoveEdge };
+
+  struct Change {
+    Op op;
+    OID_T src;
+    OID_T dst;
+    std::string label;
+  };
+
+  void Load(const std::string& path) {
+    LineReader fi(path);
+    std::string line;
+    size_t line_no = 0;
+
+    while (fi.GetLine(line)) {
+      line_no++;
+      boost::trim(line);
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+
+      std::istringstream iss(line);
+      std::string op;
+      Change change{};
+
+      iss >> op;
+      if (op == "+v" || op == "-v") {
+        change.op = op == "+v" ? Op::kAddVertex : Op::kRemoveVertex;
+        iss >> change.src;
+      } else if (op == "+e" || op == "-e") {
+        change.op = op == "+e" ? Op::kAddEdge : Op::kRemoveEdge;
+        iss >> change.src >> change.dst;
+      } else {
+        LOG(FATAL) << "Bad delta line no: " << line_no << ": " << line;
+      }
+      CHECK(!iss.fail()) << "Bad delta line no: " << line_no << ": " << line;
+
+      std::getline(iss, change.label);
+      boost::trim(change.label);
+      ToLowerAscii(&change.label[0], &change.label[0] + change.label.size());
+      CHECK(change.op != Op::kAddVertex || !change.label.empty())
+          << "Missing label at delta line no: " << line_no << ": " << line;
+      CHECK(change.op != Op::kRemoveVertex || change.label.empty())
+          << "Bad delta line no: " << line_no << ": " << line;
+      changes_.push_back(std::move(change));
+    }
+  }
+
+  const std::vector<Change>& changes() const { return changes_; }
+
+  size_t size() const { return changes_.size(); }
+
+ private:
+  std::vector<Change> changes_;
+};
+
+/**
+ * The vertices touched by applying a delta to a graph: added and removed
+ * vertices, relabeled vertices and the sources of added or removed edges.
+ * The label of each vertex before the delta, and whether it had out-edges,
+ * are kept to update structures derived from the graph.
+ */
+template <typename VERTEX_T, typename VDATA_T>
+struct GraphUpdate {
+  std::vector<VERTEX_T> vertices;
+  std::vector<VDATA_T> old_labels;
+  std::vector<bool> had_out_edges;
+  size_t n_added_vertices{};
+  size_t n_removed_vertices{};
+  size_t n_added_edges{};
+  size_t n_removed_edges{};
+};
+
+}  // namespace her
+#endif  // HER_GRAPH_DELTA_H_
@@ -2,12 +2,21 @@
 #define HER_GRAPH_LOADER_H_
 #include <glog/logging.h>
 
-#include <boost/algorithm/string.hpp>
+#include <algorithm>
 #include <boost/mpi.hpp>
-#include <fstream>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <type_traits>
 #include <vector>
 
+#include "her/config.h"
+#include "her/csr_builder.h"
 #include "her/graph.h"
+#include "her/input_file.h"
+#include "her/oid.h"
+#include "her/tokenizer.h"
+#include "her/worker_pool.h"
 
 namespace her {
 template <typename GRAPH_T>
@@ -17,105 +26,325 @@ class GraphLoader {
   using vid_t = typename GRAPH_T::vid_t;
   using vdata_t = typename GRAPH_T::vdata_t;
   using edata_t = typename GRAPH_T::edata_t;
-  using boost_graph_t = typename GRAPH_T::boost_graph_t;
+  using csr_t = typename GRAPH_T::csr_t;
+  using vertex_map_t = typename GRAPH_T::vertex_map_t;
+  using csr_builder_t = CsrBuilder<vid_t, edata_t>;
+  using oid_traits_t = OidTraits<oid_t>;
+
+  // The i-th label of a chunk is either the next view of mapped_labels,
+  // pointing into the mapped vertex file, or the next label copied to text,
+  // which ends at text_ends[k]
+  struct VertexChunk {
+    typename oid_traits_t::list_t oids;
+    std::vector<bool> mapped;
+    std::vector<boost::string_view> mapped_labels;
+    std::string text;
+    std::vector<size_t> text_ends;
+  };
+
+  // Edge data of a chunk are ids of the chunk-local dictionary labels
+  struct EdgeChunk {
+    typename csr_builder_t::Chunk edges;
+    LabelDictionary labels;
+  };
 
  public:
-  GRAPH_T LoadGraph(const std::string& vfile, const std::string& efile) {
-    auto vm_ptr = std::make_shared<VertexMap<oid_t, vid_t>>();
-    std::vector<vdata_t> vertex_data;
-    std::vector<std::pair<vid_t, vid_t>> edges;
-    std::vector<edata_t> edge_data;
+  /**
+   * Graphs loaded by this loader share label_dict as their pool of vertex
+   * labels, edge_label_dict as their edge label table and word_dict as the
+   * dictionary of the words of vertex labels. Label ids, edge label ids and
+   * word ids are therefore comparable across these graphs, and a label used
+   * by several graphs is stored and split into words once.
+   * If map_labels is true, vertex labels of plain vertex files are not copied
+   * into the pool when they are already lower-case, the pool refers to them
+   * in the mapped file, which is kept mapped as long as the pool.
+   */
+  GraphLoader(std::shared_ptr<LabelDictionary> label_dict,
+              std::shared_ptr<LabelDictionary> edge_label_dict,
+              std::shared_ptr<LabelDictionary> word_dict,
+              bool map_labels = false)
+      : label_dict_(label_dict),
+        label_tokens_(std::make_shared<TokenTable>()),
+        edge_label_dict_(edge_label_dict),
+        word_dict_(word_dict),
+        map_labels_(map_labels) {}
+
+  /**
+   * Load a graph from a vertex file and an edge file. Both files are read as
+   * newline-aligned blocks by parallelism threads, gzip files are inflated
+   * while the blocks are parsed. The vertex id follows the order of the
+   * vertex file.
+   * Vertex and edge labels are trimmed and lower-cased, vertex labels are
+   * interned into the shared label pool and edge labels into the shared edge
+   * label table. Every distinct vertex label is split into words once, the
+   * words are interned into the shared word dictionary.
+   * Given compress, the out-edges are coded into compressed rows straight
+   * from the parsed edges, see Graph::CompressEdges, the arrays of the CSR
+   * are never built.
+   */
+  GRAPH_T LoadGraph(const std::string& vfile, const std::string& efile,
+                    int parallelism = 1, bool compress = false) {
+    static_assert(std::is_same<vdata_t, label_id_t>::value,
+                  "Vertex data should be an id of the label dictionary");
+    static_assert(std::is_same<edata_t, edge_label_id_t>::value,
+                  "Edge data should be an id of the edge label table");
+    auto vm_ptr = std::make_shared<vertex_map_t>();
+    auto csr_ptr = std::make_shared<csr_t>();
+    large_vector_t<vdata_t> vertex_data;
     boost::mpi::communicator comm;
 
+    parallelism = std::max(parallelism, 1);
+
     {
-      std::ifstream fi(vfile);
-      std::string line;
-      size_t line_no = 0;
-
-      while (std::getline(fi, line)) {
-        oid_t oid;
-        vid_t lid;
-        vdata_t data;
-        ++line_no;
-        if (line_no % 1000000 == 0) {
-          VLOG(10) << "Read " << line_no << " lines";
+      InputFile file(vfile, parallelism, parallelism);
+      // Labels are only mapped from plain files, blocks of a gzip file are
+      // inflated copies
+      auto mapped_file = map_labels_ ? file.mapped_file() : nullptr;
+      bool map = mapped_file != nullptr;
+      std::vector<VertexChunk> chunks;
+      std::mutex chunk_mutex;
+
+      ParallelFor(parallelism, [&file, map, &chunks, &chunk_mutex](size_t) {
+        InputBlock block;
+
+        while (file.NextBlock(block)) {
+          VertexChunk chunk;
+
+          ForEachLine(block, [&](const char* p, const char* end) {
+            typename oid_traits_t::ref_t oid;
+
+            CHECK(oid_traits_t::Scan(p, end, oid))
+                << "Bad vertex line no: " << file.LineNo(block, p) << ": "
+                << std::string(p, end);
+
+            auto label = TrimmedRest(p, end);
+
+            chunk.oids.push_back(oid);
+            // A label with upper-case letters differs from its lower-cased
+            // form, so it has to be copied
+            if (map && !HasUpperAscii(label.data(),
+                                      label.data() + label.size())) {
+              chunk.mapped.push_back(true);
+              chunk.mapped_labels.push_back(label);
+            } else {
+              chunk.mapped.push_back(false);
+              chunk.text.append(label.data(), label.size());
+              chunk.text_ends.push_back(chunk.text.size());
+            }
+          });
+          // All copied labels of the chunk are lower-cased in one pass
+          ToLowerAscii(&chunk.text[0], &chunk.text[0] + chunk.text.size());
+          VLOG(10) << "Parsed " << chunk.oids.size() << " vertices";
+          StoreChunk(block.index, std::move(chunk), chunks, chunk_mutex);
+        }
+      });
+
+      typename oid_traits_t::list_t oids;
+      oid_t duplicate;
+
+      for (auto& chunk : chunks) {
+        oid_traits_t::Append(oids, chunk.oids);
+        chunk.oids = typename oid_traits_t::list_t();
+      }
+      CHECK(vm_ptr->BulkBuild(std::move(oids), parallelism, duplicate))
+          << "Duplicate vertex: " << duplicate;
+
+      size_t n_new_labels;
+
+      vertex_data.reserve(vm_ptr->TotalVertexNum());
+      {
+        std::lock_guard<std::mutex> lock(label_mutex_);
+        size_t n_labels = label_dict_->size();
+
+        for (auto& chunk : chunks) {
+          size_t n_mapped = 0, n_copied = 0, text_begin = 0;
+
+          for (bool mapped : chunk.mapped) {
+            if (mapped) {
+              vertex_data.push_back(
+                  label_dict_->InternView(chunk.mapped_labels[n_mapped++]));
+            } else {
+              size_t text_end = chunk.text_ends[n_copied++];
+
+              vertex_data.push_back(label_dict_->Intern(boost::string_view(
+                  chunk.text.data() + text_begin, text_end - text_begin)));
+              text_begin = text_end;
+            }
+          }
+          chunk = VertexChunk();
+        }
+        if (map) {
+          // Labels are looked up randomly from now on
+          mapped_file->Advise(MADV_NORMAL);
+          label_dict_->Retain(mapped_file);
         }
-        if (line.empty() || line[0] == '#')
-          continue;
-
-        std::istringstream ss(line);
-        ss >> oid;
-        ss.ignore(1);  // whitespace
-        std::getline(ss, data);
-
-        CHECK(vm_ptr->AddVertex(oid, lid))
-            << "Duplicate vertex: " << oid << " line no: " << line_no;
-        boost::trim(data);
-        vertex_data.push_back(data);
+        // Only the labels new to the pool are split into words
+        label_tokens_->Tokenize(*label_dict_, *word_dict_);
+        n_new_labels = label_dict_->size() - n_labels;
       }
-      fi.close();
       LOG(INFO) << "Rank: " << comm.rank() << " Loaded " << vfile << ": "
-                << vm_ptr->TotalVertexNum() << " vertices.";
+                << vm_ptr->TotalVertexNum() << " vertices, " << n_new_labels
+                << " labels new to the pool, "
+                << (vm_ptr->mode() == vertex_map_t::Mode::kDense ? "dense"
+                                                                 : "hashed")
+                << " vertex map.";
     }
 
     {
-      std::ifstream fi(efile);
-      std::string line;
-      size_t line_no = 0;
-
-      while (std::getline(fi, line)) {
-        oid_t src_oid, dst_oid;
-        vid_t src_lid, dst_lid;
-        edata_t data;
-        ++line_no;
-        if (line_no % 1000000 == 0) {
-          VLOG(10) << "Read " << line_no << " lines";
+      InputFile file(efile, parallelism, parallelism);
+      std::vector<EdgeChunk> chunks;
+      std::mutex chunk_mutex;
+      const auto& vm = *vm_ptr;
+      csr_builder_t builder(vm.TotalVertexNum(), parallelism);
+
+      ParallelFor(parallelism, [&file, &efile, &chunks, &chunk_mutex, &vm,
+                                &builder](size_t) {
+        InputBlock block;
+
+        while (file.NextBlock(block)) {
+          EdgeChunk chunk;
+
+          chunk.edges = builder.NewChunk();
+
+          ForEachLine(block, [&](const char* line, const char* end) {
+            const char* p = line;
+            typename oid_traits_t::ref_t src_oid, dst_oid;
+            vid_t src_lid, dst_lid;
+
+            CHECK(oid_traits_t::Scan(p, end, src_oid) &&
+                  oid_traits_t::Scan(p, end, dst_oid))
+                << "Bad edge line no: " << file.LineNo(block, line)
+                << ": " << std::string(line, end);
+            CHECK(vm.GetLid(src_oid, src_lid))
+                << "Missing src vertex " << src_oid
+                << ". Failed to process edge: " << std::string(line, end);
+            CHECK(vm.GetLid(dst_oid, dst_lid))
+                << "Missing dst vertex " << dst_oid
+                << ". Failed to process edge: " << std::string(line, end);
+            auto label_id = chunk.labels.Intern(TrimmedRest(p, end));
+
+            CHECK(label_id <= kMaxEdgeLabelId)
+                << "Too many distinct edge labels in " << efile;
+            builder.Add(chunk.edges, src_lid, dst_lid, label_id);
+          });
+          VLOG(10) << "Parsed " << csr_builder_t::EdgeNum(chunk.edges)
+                   << " edges";
+          StoreChunk(block.index, std::move(chunk), chunks, chunk_mutex);
         }
-        if (line.empty() || line[0] == '#')
-          continue;
-
-        std::istringstream ss(line);
-
-        ss >> src_oid;
-        ss >> dst_oid;
-        ss.ignore(1);  // whitespace
-        std::getline(ss, data);
-
-        CHECK(vm_ptr->GetLid(src_oid, src_lid))
-            << "Missing src vertex " << src_oid
-            << ". Failed to process edge: " << line;
-        CHECK(vm_ptr->GetLid(dst_oid, dst_lid))
-            << "Missing dst vertex " << dst_oid
-            << ". Failed to process edge: " << line;
-        edges.template emplace_back(src_lid, dst_lid);
-        boost::trim(data);
-        edge_data.template emplace_back(data);
+      });
+
+      std::vector<typename csr_builder_t::Chunk> edges;
+      size_t n_edges = 0;
+
+      for (auto& chunk : chunks) {
+        // Labels are lower-cased once per distinct label of the chunk, before
+        // they are merged into the shared table
+        std::vector<edata_t> local_to_global(chunk.labels.size());
+
+        {
+          std::lock_guard<std::mutex> lock(edge_label_mutex_);
+
+          for (label_id_t id = 0; id < chunk.labels.size(); id++) {
+            auto label = chunk.labels.Get(id).to_string();
+
+            ToLowerAscii(&label[0], &label[0] + label.size());
+
+            auto global_id = edge_label_dict_->Intern(label);
+
+            CHECK(global_id <= kMaxEdgeLabelId)
+                << "Too many distinct edge labels";
+            local_to_global[id] = global_id;
+          }
+        }
+
+        for (auto& data : chunk.edges.data) {
+          for (auto& label_id : data) {
+            label_id = local_to_global[label_id];
+          }
+        }
+        n_edges += csr_builder_t::EdgeNum(chunk.edges);
+        edges.push_back(std::move(chunk.edges));
+        chunk = EdgeChunk();
+      }
+
+      if (compress) {
+        builder.BuildCompressed(edges, csr_ptr->compressed);
+        csr_ptr->offsets = large_vector_t<size_t>();
+      } else {
+        builder.Build(edges, *csr_ptr);
       }
-      fi.close();
       LOG(INFO) << "Rank: " << comm.rank() << " Loaded " << efile << ": "
-                << edges.size() << " edges.";
+                << n_edges << " edges.";
     }
 
-    std::size_t nvnum = vm_ptr->TotalVertexNum();
-    auto graph_ptr = std::make_shared<boost_graph_t>(
-        boost::edges_are_unsorted_multi_pass, edges.begin(), edges.end(),
-        edge_data.begin(), nvnum);
-    auto& g = *graph_ptr;
+    csr_ptr->vertex_data = std::move(vertex_data);
 
-    int index = 0;
+    return GRAPH_T(vm_ptr, csr_ptr, label_dict_, label_tokens_,
+                   edge_label_dict_, word_dict_);
+  }
 
-    std::pair<typename boost::graph_traits<boost_graph_t>::vertex_iterator,
-              typename boost::graph_traits<boost_graph_t>::vertex_iterator>
-        vertices = boost::vertices(g);
+ private:
+  /**
+   * Call func(line_begin, line_end) for every line of the block, blank lines
+   * and lines starting with '#' are skipped.
+   */
+  template <typename FUNC_T>
+  static void ForEachLine(const InputBlock& block, const FUNC_T& func) {
+    const char* p = block.begin;
+    const char* end = block.end;
+
+    while (p < end) {
+      auto* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+      const char* line_end = nl == nullptr ? end : nl;
+      const char* q = p;
 
-    for (auto it = vertices.first; it != vertices.second; it++) {
-      typename boost::graph_traits<boost_graph_t>::vertex_descriptor vd = *it;
+      while (q < line_end && IsBlankChar(*q)) {
+        q++;
+      }
+      if (q < line_end && *p != '#') {
+        func(p, line_end);
+      }
+      p = line_end + 1;
+    }
+  }
 
-      g[vd] = vertex_data[index++];
+  // The remaining of the line with surrounding blanks trimmed
+  static boost::string_view TrimmedRest(const char* p, const char* end) {
+    while (p < end && IsBlankChar(*p)) {
+      p++;
     }
+    while (end > p && IsBlankChar(*(end - 1))) {
+      end--;
+    }
+    return boost::string_view(p, end - p);
+  }
+
+  /**
+   * Put the chunk parsed from the index-th block of a file at its position,
+   * so chunks stay in file order whichever thread parsed them.
+   */
+  template <typename CHUNK_T>
+  static void StoreChunk(size_t index, CHUNK_T&& chunk,
+                         std::vector<CHUNK_T>& chunks, std::mutex& mutex) {
+    std::lock_guard<std::mutex> lock(mutex);
 
-    return {vm_ptr, graph_ptr};
+    if (chunks.size() <= index) {
+      chunks.resize(index + 1);
+    }
+    chunks[index] = std::move(chunk);
   }
+
+  static constexpr label_id_t kMaxEdgeLabelId =
+      std::numeric_limits<edata_t>::max();
+
+  std::shared_ptr<LabelDictionary> label_dict_;
+  std::shared_ptr<TokenTable> label_tokens_;
+  std::shared_ptr<LabelDictionary> edge_label_dict_;
+  std::shared_ptr<LabelDictionary> word_dict_;
+  bool map_labels_;
+  // Guards the label pool, its tokens and the word dictionary
+  std::mutex label_mutex_;
+  std::mutex edge_label_mutex_;
 };
 
 }  // namespace her
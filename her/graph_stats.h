@@ -0,0 +1,399 @@
+#ifndef HER_GRAPH_STATS_H_
+#define HER_GRAPH_STATS_H_
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "boost/utility/string_view.hpp"
+#include "glog/logging.h"
+#include "her/snapshot.h"
+#include "her/source_vertices.h"
+#include "her/worker_pool.h"
+
+namespace her {
+// The number of hubs and of most frequent vertex labels kept by GraphStats
+static constexpr size_t kStatsTopVertices = 16;
+static constexpr size_t kStatsTopLabels = 16;
+static constexpr size_t kStatsDegreeBuckets = 65;
+
+// The bucket of the out-degree histogram of GraphStats holding degree
+inline size_t DegreeBucket(uint64_t degree) {
+  return degree == 0 ? 0 : 64 - __builtin_clzll(degree);
+}
+
+/**
+ * Facts about a loaded graph gathered by ComputeGraphStats. They are written
+ * into snapshots with the graph, so query engines can make cost-based
+ * decisions without a pass over the graph.
+ */
+struct GraphStats {
+  uint64_t n_vertices{};
+  uint64_t n_edges{};
+  uint64_t max_out_degree{};
+  // The number of vertices by out-degree, bucket 0 counts the vertices
+  // without out-edges and bucket i > 0 the degrees in [2^(i-1), 2^i)
+  std::vector<uint64_t> degree_histogram;
+  // The vertices of the highest out-degrees, by decreasing degree
+  std::vector<uint64_t> hubs;
+  std::vector<uint64_t> hub_degrees;
+  // The number of distinct vertex labels, and the most frequent ones by
+  // decreasing count
+  uint64_t n_labels{};
+  std::vector<uint64_t> top_labels;
+  std::vector<uint64_t> top_label_counts;
+  // The number of edges of every edge label id
+  std::vector<uint64_t> edge_label_counts;
+  uint64_t n_sources{};
+  // The mean number of vertices first reached after d + 1 hops from a source
+  // entity, over n_sampled_sources of them
+  std::vector<double> descendants;
+  uint64_t n_sampled_sources{};
+
+  double MeanOutDegree() const {
+    return n_vertices == 0 ? 0 : static_cast<double>(n_edges) / n_vertices;
+  }
+
+  void Serialize(SnapshotWriter& writer) const {
+    writer.WritePod(n_vertices);
+    writer.WritePod(n_edges);
+    writer.WritePod(max_out_degree);
+    writer.WriteVector(degree_histogram);
+    writer.WriteVector(hubs);
+    writer.WriteVector(hub_degrees);
+    writer.WritePod(n_labels);
+    writer.WriteVector(top_labels);
+    writer.WriteVector(top_label_counts);
+    writer.WriteVector(edge_label_counts);
+    writer.WritePod(n_sources);
+    writer.WriteVector(descendants);
+    writer.WritePod(n_sampled_sources);
+  }
+
+  void Deserialize(SnapshotReader& reader) {
+    n_vertices = reader.ReadPod<uint64_t>();
+    n_edges = reader.ReadPod<uint64_t>();
+    max_out_degree = reader.ReadPod<uint64_t>();
+    reader.ReadVector(degree_histogram);
+    reader.ReadVector(hubs);
+    reader.ReadVector(hub_degrees);
+    n_labels = reader.ReadPod<uint64_t>();
+    reader.ReadVector(top_labels);
+    reader.ReadVector(top_label_counts);
+    reader.ReadVector(edge_label_counts);
+    n_sources = reader.ReadPod<uint64_t>();
+    reader.ReadVector(descendants);
+    n_sampled_sources = reader.ReadPod<uint64_t>();
+    CHECK(hubs.size() == hub_degrees.size() &&
+          top_labels.size() == top_label_counts.size())
+        << "Corrupted snapshot";
+  }
+};
+
+/**
+ * The statistics of GD and G, see -stats_sources and -stats_file.
+ */
+struct GraphCatalog {
+  GraphStats gd;
+  GraphStats g;
+
+  void Serialize(SnapshotWriter& writer) const {
+    gd.Serialize(writer);
+    g.Serialize(writer);
+  }
+
+  void Deserialize(SnapshotReader& reader) {
+    gd.Deserialize(reader);
+    g.Deserialize(reader);
+  }
+};
+
+/**
+ * Gather the statistics of g by parallelism threads. Every thread counts the
+ * degrees and labels of a range of vertices, and runs a breadth-first search
+ * of depth hops over all out-edges from a share of n_samples source
+ * entities, evenly spaced in sources. The result does not depend on
+ * parallelism.
+ */
+template <typename GRAPH_T>
+GraphStats ComputeGraphStats(const GRAPH_T& g,
+                             const SourceVertices<GRAPH_T>& sources,
+                             int depth, size_t n_samples, int parallelism) {
+  using vertex_t = typename GRAPH_T::vertex_t;
+  using edata_t = typename GRAPH_T::edata_t;
+  // A hub is better than another one by a higher degree, then a lower id
+  using hub_t = std::pair<uint64_t, vertex_t>;
+  auto better = [](const hub_t& a, const hub_t& b) {
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+  };
+  size_t n_vertices = g.Vertices().size();
+  size_t n_edge_labels = g.edge_label_dict().size();
+  size_t n_chunks = std::max(parallelism, 1);
+  size_t chunk_size = (n_vertices + n_chunks - 1) / n_chunks;
+
+  n_samples = std::min(n_samples, sources.size());
+
+  size_t sample_chunk_size = (n_samples + n_chunks - 1) / n_chunks;
+  std::vector<std::atomic<uint32_t>> label_counts(g.label_dict().size());
+  std::vector<GraphStats> partials(n_chunks);
+  std::vector<std::vector<hub_t>> hubs(n_chunks);
+  std::vector<std::vector<uint64_t>> reached(n_chunks);
+
+  ParallelFor(n_chunks, [&](size_t i) {
+    size_t begin = std::min(i * chunk_size, n_vertices);
+    size_t end = std::min(begin + chunk_size, n_vertices);
+    auto& partial = partials[i];
+    auto& top = hubs[i];  // a heap whose top is the worst hub kept
+
+    partial.degree_histogram.assign(kStatsDegreeBuckets, 0);
+    partial.edge_label_counts.assign(n_edge_labels, 0);
+    for (size_t v = begin; v < end; v++) {
+      uint64_t degree = 0;
+
+      g.VisitOutEdges(v, {}, [&](vertex_t, edata_t data) {
+        if (data < n_edge_labels) {
+          partial.edge_label_counts[data]++;
+        }
+        degree++;
+        return true;
+      });
+      partial.n_edges += degree;
+      partial.max_out_degree = std::max(partial.max_out_degree, degree);
+      partial.degree_histogram[DegreeBucket(degree)]++;
+      label_counts[g[v]].fetch_add(1, std::memory_order_relaxed);
+
+      hub_t hub(degree, v);
+
+      if (top.size() < kStatsTopVertices) {
+        top.push_back(hub);
+        std::push_heap(top.begin(), top.end(), better);
+      } else if (better(hub, top.front())) {
+        std::pop_heap(top.begin(), top.end(), better);
+        top.back() = hub;
+        std::push_heap(top.begin(), top.end(), better);
+      }
+    }
+
+    size_t sample_begin = std::min(i * sample_chunk_size, n_samples);
+    size_t sample_end = std::min(sample_begin + sample_chunk_size, n_samples);
+    std::unordered_set<vertex_t> visited;
+    std::vector<vertex_t> frontier, next;
+
+    reached[i].assign(std::max(depth, 0), 0);
+    for (size_t j = sample_begin; j < sample_end; j++) {
+      auto src = sources.vertices()[j * sources.size() / n_samples];
+
+      visited.clear();
+      visited.insert(src);
+      frontier.assign(1, src);
+      for (int d = 0; d < depth && !frontier.empty(); d++) {
+        next.clear();
+        for (auto u : frontier) {
+          g.VisitOutEdges(u, {}, [&](vertex_t v, edata_t) {
+            if (visited.insert(v).second) {
+              next.push_back(v);
+            }
+            return true;
+          });
+        }
+        reached[i][d] += next.size();
+        frontier.swap(next);
+      }
+    }
+  });
+
+  GraphStats stats;
+  std::vector<hub_t> top;
+
+  stats.n_vertices = n_vertices;
+  stats.degree_histogram.assign(kStatsDegreeBuckets, 0);
+  stats.edge_label_counts.assign(n_edge_labels, 0);
+  stats.descendants.assign(std::max(depth, 0), 0);
+  for (size_t i = 0; i < n_chunks; i++) {
+    auto& partial = partials[i];
+
+    stats.n_edges += partial.n_edges;
+    stats.max_out_degree = std::max(stats.max_out_degree,
+                                    partial.max_out_degree);
+    for (size_t b = 0; b < stats.degree_histogram.size(); b++) {
+      stats.degree_histogram[b] += partial.degree_histogram[b];
+    }
+    for (size_t l = 0; l < n_edge_labels; l++) {
+      stats.edge_label_counts[l] += partial.edge_label_counts[l];
+    }
+    for (size_t d = 0; d < stats.descendants.size(); d++) {
+      stats.descendants[d] += reached[i][d];
+    }
+    top.insert(top.end(), hubs[i].begin(), hubs[i].end());
+  }
+  // Trailing empty buckets are dropped
+  auto& histogram = stats.degree_histogram;
+
+  while (!histogram.empty() && histogram.back() == 0) {
+    histogram.pop_back();
+  }
+  std::sort(top.begin(), top.end(), better);
+  top.resize(std::min(top.size(), kStatsTopVertices));
+  for (auto& hub : top) {
+    stats.hubs.push_back(hub.second);
+    stats.hub_degrees.push_back(hub.first);
+  }
+
+  // Label ids depend on the order of loading, so labels are ranked by a
+  // higher count and then by name
+  std::vector<std::pair<uint64_t, uint64_t>> labels;
+  auto& label_dict = g.label_dict();
+
+  for (size_t l = 0; l < label_counts.size(); l++) {
+    uint64_t count = label_counts[l].load(std::memory_order_relaxed);
+
+    if (count > 0) {
+      stats.n_labels++;
+      labels.emplace_back(count, l);
+    }
+  }
+
+  size_t n_top_labels = std::min(labels.size(), kStatsTopLabels);
+
+  std::partial_sort(labels.begin(), labels.begin() + n_top_labels,
+                    labels.end(),
+                    [&label_dict](const std::pair<uint64_t, uint64_t>& a,
+                                  const std::pair<uint64_t, uint64_t>& b) {
+                      return a.first > b.first ||
+                             (a.first == b.first &&
+                              label_dict.Get(a.second) <
+                                  label_dict.Get(b.second));
+                    });
+  for (size_t j = 0; j < n_top_labels; j++) {
+    stats.top_labels.push_back(labels[j].second);
+    stats.top_label_counts.push_back(labels[j].first);
+  }
+
+  stats.n_sources = sources.size();
+  stats.n_sampled_sources = n_samples;
+  for (auto& mean : stats.descendants) {
+    mean = n_samples == 0 ? 0 : mean / n_samples;
+  }
+  return stats;
+}
+
+// s as a JSON string
+inline std::string JsonString(boost::string_view s) {
+  std::string out = "\"";
+
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+  return out;
+}
+
+// An integer oid as a JSON number, a string oid as a JSON string
+template <typename OID_T>
+std::string JsonOid(const OID_T& oid) {
+  return std::to_string(oid);
+}
+
+inline std::string JsonOid(const std::string& oid) { return JsonString(oid); }
+
+/**
+ * Write the statistics of graph g as a JSON object, every line indented by
+ * indent. Vertices and labels are given by their oids and names.
+ */
+template <typename GRAPH_T>
+void WriteGraphStatsJson(std::ostream& os, const GraphStats& stats,
+                         const GRAPH_T& g, const std::string& indent) {
+  os << "{\n";
+  os << indent << "  \"vertices\": " << stats.n_vertices << ",\n";
+  os << indent << "  \"edges\": " << stats.n_edges << ",\n";
+  os << indent << "  \"mean_out_degree\": " << stats.MeanOutDegree()
+     << ",\n";
+  os << indent << "  \"max_out_degree\": " << stats.max_out_degree << ",\n";
+  os << indent << "  \"out_degree_histogram\": [";
+  for (size_t b = 0; b < stats.degree_histogram.size(); b++) {
+    os << (b == 0 ? "" : ", ") << "{\"min\": " << (b == 0 ? 0 : 1ull << (b - 1))
+       << ", \"vertices\": " << stats.degree_histogram[b] << "}";
+  }
+  os << "],\n";
+  os << indent << "  \"hubs\": [";
+  for (size_t j = 0; j < stats.hubs.size(); j++) {
+    auto v = static_cast<typename GRAPH_T::vertex_t>(stats.hubs[j]);
+
+    os << (j == 0 ? "" : ", ") << "{\"oid\": " << JsonOid(g.GetId(v))
+       << ", \"out_degree\": " << stats.hub_degrees[j] << "}";
+  }
+  os << "],\n";
+  os << indent << "  \"labels\": " << stats.n_labels << ",\n";
+  os << indent << "  \"top_labels\": [";
+  for (size_t j = 0; j < stats.top_labels.size(); j++) {
+    os << (j == 0 ? "" : ", ") << "{\"label\": "
+       << JsonString(g.label_dict().Get(stats.top_labels[j]))
+       << ", \"vertices\": " << stats.top_label_counts[j] << "}";
+  }
+  os << "],\n";
+  // Edge label ids depend on the order of loading, so edge labels are
+  // listed by decreasing count and then by name
+  std::vector<std::pair<uint64_t, boost::string_view>> edge_labels;
+
+  for (size_t l = 0; l < stats.edge_label_counts.size(); l++) {
+    if (stats.edge_label_counts[l] > 0) {
+      edge_labels.emplace_back(stats.edge_label_counts[l],
+                               g.edge_label_dict().Get(l));
+    }
+  }
+  std::sort(edge_labels.begin(), edge_labels.end(),
+            [](const std::pair<uint64_t, boost::string_view>& a,
+               const std::pair<uint64_t, boost::string_view>& b) {
+              return a.first > b.first ||
+                     (a.first == b.first && a.second < b.second);
+            });
+  os << indent << "  \"edge_labels\": {";
+  for (size_t j = 0; j < edge_labels.size(); j++) {
+    os << (j == 0 ? "" : ", ") << JsonString(edge_labels[j].second) << ": "
+       << edge_labels[j].first;
+  }
+  os << "},\n";
+  os << indent << "  \"source_entities\": " << stats.n_sources << ",\n";
+  os << indent << "  \"sampled_source_entities\": " << stats.n_sampled_sources
+     << ",\n";
+  os << indent << "  \"mean_descendants_by_depth\": [";
+  for (size_t d = 0; d < stats.descendants.size(); d++) {
+    os << (d == 0 ? "" : ", ") << stats.descendants[d];
+  }
+  os << "]\n";
+  os << indent << "}";
+}
+
+template <typename GRAPH_T>
+void WriteGraphCatalogJson(const std::string& path,
+                           const GraphCatalog& catalog, const GRAPH_T& gd,
+                           const GRAPH_T& g) {
+  std::ofstream fo(path);
+
+  CHECK(fo.is_open()) << "Failed to open " << path;
+  fo << "{\n  \"gd\": ";
+  WriteGraphStatsJson(fo, catalog.gd, gd, "  ");
+  fo << ",\n  \"g\": ";
+  WriteGraphStatsJson(fo, catalog.g, g, "  ");
+  fo << "\n}\n";
+  fo.close();
+  CHECK(!fo.fail()) << "Failed to write " << path;
+}
+
+}  // namespace her
+#endif  // HER_GRAPH_STATS_H_
@@ -1,6 +1,7 @@
 #ifndef HER_HER_H_
 #define HER_HER_H_
 #include <boost/mpi.hpp>
+#include <fstream>
 #include <ostream>
 #include <queue>
 #include <thread>
@@ -8,11 +9,21 @@
 #include "her/apair_parallel.h"
 #include "her/config.h"
 #include "her/flags.h"
+#include "her/graph_delta.h"
 #include "her/graph_loader.h"
+#include "her/graph_stats.h"
+#include "her/input_file.h"
 #include "her/inverted_index.h"
+#include "her/label_dictionary.h"
+#include "her/memory_policy.h"
 #include "her/processing_utils.h"
+#include "her/reorder.h"
+#include "her/snapshot.h"
+#include "her/source_vertices.h"
+#include "her/task_graph.h"
 #include "her/timer.h"
 #include "her/vpair.h"
+#include "her/word_embedding.h"
 
 namespace her {
 int GetParallelism(boost::mpi::communicator& comm) {
@@ -27,22 +38,528 @@ int GetParallelism(boost::mpi::communicator& comm) {
   return parallelism;
 }
 
+/**
+ * Set the policy of the large arrays from -huge_pages and -numa_policy, it
+ * has to be set before any of them is allocated.
+ */
+void SetLargeArrayPolicy() {
+  HugePagePolicy huge_pages;
+  NumaPolicy numa;
+
+  if (!ParseHugePagePolicy(FLAGS_huge_pages, huge_pages)) {
+    LOG(FATAL) << "Invalid param: -huge_pages = " << FLAGS_huge_pages;
+  }
+  if (!ParseNumaPolicy(FLAGS_numa_policy, numa)) {
+    LOG(FATAL) << "Invalid param: -numa_policy = " << FLAGS_numa_policy;
+  }
+  LargeArrayRegistry::Get().SetPolicy(huge_pages, numa);
+}
+
+/**
+ * Load the optional descendants (-desc_file) and paths (-path_file) of G.
+ * Labels of paths are interned into the edge label table of G.
+ */
+template <typename GRAPH_T>
+void LoadPathData(
+    boost::mpi::communicator& comm, GRAPH_T& g,
+    LabelDictionary& edge_label_dict,
+    std::vector<std::vector<std::pair<typename GRAPH_T::vertex_t, depth_t>>>&
+        g_descendants,
+    std::unordered_map<typename GRAPH_T::vertex_t,
+                       std::unordered_map<typename GRAPH_T::vertex_t,
+                                          edge_label_path_t>>& g_path) {
+  using oid_t = typename GRAPH_T::oid_t;
+  using vertex_t = typename GRAPH_T::vertex_t;
+
+  std::string desc_file = FLAGS_desc_file;
+  std::string path_file = FLAGS_path_file;
+
+  if (!desc_file.empty() && access(desc_file.c_str(), 0) != 0) {
+    LOG(FATAL) << "Invalid param: -desc_file = " << desc_file;
+  }
+  if (!path_file.empty() && access(path_file.c_str(), 0) != 0) {
+    LOG(FATAL) << "Invalid param: -path_file = " << path_file;
+  }
+
+  if (!desc_file.empty()) {
+    LineReader fi(desc_file);
+    std::string line;
+    size_t n_desc = 0;
+
+    g_descendants.resize(g.Vertices().size());
+
+    while (fi.GetLine(line)) {
+      std::istringstream iss(line);
+      oid_t v_oid;
+      depth_t depth;
+      vertex_t v;
+
+      iss >> v_oid;
+
+      if (g.GetVertex(v_oid, v)) {
+        auto& descendants = g_descendants[v];
+
+        while (iss >> v_oid >> depth) {
+          if (g.GetVertex(v_oid, v)) {
+            descendants.emplace_back(v, depth);
+            n_desc++;
+          }
+        }
+      }
+    }
+
+    if (comm.rank() == 0) {
+      LOG(INFO) << "Read " << n_desc << " descendants";
+    }
+  }
+
+  if (!path_file.empty()) {
+    LineReader fi(path_file);
+    std::string line;
+    size_t n_path = 0;
+
+    while (fi.GetLine(line)) {
+      std::istringstream iss(line);
+      oid_t v1_oid, v2_oid;
+      vertex_t v1, v2;
+      std::string path_labels;
+      std::vector<std::string> labels;
+
+      iss >> v1_oid;
+      iss >> v2_oid;
+      iss >> path_labels;
+
+      boost::to_lower(path_labels);
+      boost::split(labels, path_labels, boost::is_any_of(";,"),
+                   boost::token_compress_on);
+
+      edge_label_path_t path;
+
+      for (auto& label : labels) {
+        if (!label.empty()) {
+          auto id = edge_label_dict.Intern(label);
+
+          CHECK(id <= std::numeric_limits<edge_label_id_t>::max())
+              << "Too many distinct edge labels";
+          path.push_back(id);
+        }
+      }
+
+      if (g.GetVertex(v1_oid, v1) && g.GetVertex(v2_oid, v2)) {
+        g_path[v1][v2] = path;
+        n_path++;
+      }
+    }
+
+    if (comm.rank() == 0) {
+      LOG(INFO) << "Read " << n_path << " paths";
+    }
+  }
+}
+
+static constexpr char kEmbeddingSidecarSuffix[] = ".herbin";
+
+// Return true if path_a was modified after path_b
+inline bool IsNewer(const std::string& path_a, const std::string& path_b) {
+  struct stat st_a, st_b;
+
+  return stat(path_a.c_str(), &st_a) == 0 &&
+         stat(path_b.c_str(), &st_b) == 0 && st_a.st_mtime > st_b.st_mtime;
+}
+
+/**
+ * Load the word embedding from a text file. If vocabulary is given, only the
+ * vectors of its words are kept. Otherwise, the sidecar file is used if
+ * -embedding_sidecar is given.
+ */
+template <typename coord_t>
+void LoadWordEmbedding(boost::mpi::communicator& comm,
+                       const std::string& embedding_file,
+                       const LabelDictionary* vocabulary, int parallelism,
+                       WordEmbedding<coord_t>& word_embeddings) {
+  std::string sidecar = embedding_file + kEmbeddingSidecarSuffix;
+  std::string source = embedding_file;
+  bool use_sidecar = FLAGS_embedding_sidecar && vocabulary == nullptr;
+
+  if (use_sidecar && IsSnapshotFile(sidecar) &&
+      IsNewer(sidecar, embedding_file)) {
+    SnapshotReader reader(sidecar);
+
+    word_embeddings.Deserialize(reader);
+    source = sidecar;
+  } else {
+    word_embeddings.Load(embedding_file, parallelism, vocabulary);
+    if (use_sidecar && comm.rank() == 0) {
+      SnapshotWriter writer(sidecar);
+
+      word_embeddings.Serialize(writer);
+      writer.Close();
+      LOG(INFO) << "Wrote " << sidecar;
+    }
+  }
+
+  if (comm.rank() == 0) {
+    LOG(INFO) << "Rank: " << comm.rank() << " Loaded " << source << ": "
+              << word_embeddings.size() << " words, " << word_embeddings.dim()
+              << " dims, " << word_embeddings.MatrixBytes() << " bytes";
+    if (vocabulary != nullptr) {
+      LOG(INFO) << "Vocabulary: " << vocabulary->size() << " words, "
+                << word_embeddings.n_pruned() << " lines pruned";
+    }
+  }
+}
+
+/**
+ * The delta files of -g_delta_file in the order they are applied.
+ */
+inline std::vector<std::string> DeltaFiles() {
+  std::vector<std::string> delta_files, files;
+
+  boost::split(delta_files, FLAGS_g_delta_file, boost::is_any_of(","),
+               boost::token_compress_on);
+  for (auto& delta_file : delta_files) {
+    if (delta_file.empty()) {
+      continue;
+    }
+    if (access(delta_file.c_str(), 0) != 0) {
+      LOG(FATAL) << "Invalid param: -g_delta_file = " << delta_file;
+    }
+    files.push_back(delta_file);
+  }
+  return files;
+}
+
+/**
+ * The words whose vectors may be looked up: the words of vertex labels of GD
+ * and G, of edge labels and of the synonym file.
+ */
+template <typename coord_t>
+LabelDictionary BuildVocabulary(
+    const LabelDictionary& word_dict, const LabelDictionary& edge_label_dict,
+    const std::unordered_map<std::pair<std::string, std::string>, coord_t>&
+        synonym) {
+  // The words of vertex labels are already split by the loader
+  LabelDictionary vocabulary = word_dict;
+
+  CollectWords(edge_label_dict, vocabulary);
+  for (auto& pair : synonym) {
+    for (auto* text : {&pair.first.first, &pair.first.second}) {
+      ForEachToken(*text, [&vocabulary](boost::string_view word) {
+        vocabulary.Intern(word);
+      });
+    }
+  }
+  return vocabulary;
+}
+
+/**
+ * Add the words of the labels in the delta files to vocabulary, the vectors
+ * of labels added by a delta are looked up when it is applied.
+ */
+template <typename OID_T>
+void CollectDeltaWords(LabelDictionary& vocabulary) {
+  for (auto& delta_file : DeltaFiles()) {
+    GraphDelta<OID_T> delta;
+
+    delta.Load(delta_file);
+    for (auto& change : delta.changes()) {
+      ForEachToken(change.label, [&vocabulary](boost::string_view word) {
+        vocabulary.Intern(word);
+      });
+    }
+  }
+}
+
+/**
+ * Flag the ids of the dictionary whose label is a source label.
+ */
+inline std::vector<bool> ResolveSourceLabels(
+    const LabelDictionary& dict,
+    const std::unordered_set<std::string>& source_labels) {
+  std::vector<bool> flags(dict.size(), false);
+
+  for (auto& label : source_labels) {
+    label_id_t id;
+
+    if (dict.Find(label, id)) {
+      flags[id] = true;
+    }
+  }
+  return flags;
+}
+
+/**
+ * Drop the labels of the pool that no vertex of GD and G has, e.g. after G is
+ * pruned. The remaining labels keep their relative order, the pool, its tokens
+ * and the word dictionary are rebuilt in place, so both graphs see them.
+ */
+template <typename GRAPH_T>
+void CompactLabelPool(GRAPH_T& gd, GRAPH_T& g) {
+  auto label_dict = g.label_dict_ptr();
+  std::vector<bool> used(label_dict->size(), false);
+  std::vector<label_id_t> new_labels(label_dict->size(), kInvalidLabel);
+  LabelDictionary compacted;
+
+  // Mapped labels stay in the mapped files rather than being copied out
+  if (FLAGS_map_vertex_labels) {
+    compacted.Retain(*label_dict);
+  }
+  for (auto* graph : {&gd, &g}) {
+    for (auto v : graph->Vertices()) {
+      used[(*graph)[v]] = true;
+    }
+  }
+  for (label_id_t label = 0; label < label_dict->size(); label++) {
+    if (used[label]) {
+      new_labels[label] = FLAGS_map_vertex_labels
+                              ? compacted.InternView(label_dict->Get(label))
+                              : compacted.Intern(label_dict->Get(label));
+    }
+  }
+  for (auto* graph : {&gd, &g}) {
+    for (auto v : graph->Vertices()) {
+      graph->SetData(v, new_labels[(*graph)[v]]);
+    }
+  }
+  *label_dict = std::move(compacted);
+  *g.label_tokens_ptr() = TokenTable();
+  *g.word_dict_ptr() = LabelDictionary();
+  g.label_tokens_ptr()->Tokenize(*label_dict, *g.word_dict_ptr());
+}
+
+/**
+ * Keep only the vertices of G that APair may reach, see -prune_g. A vertex is
+ * kept if it is reachable from a source entity of G within -prune_depth hops.
+ * The ids of G are compacted, the descendants and paths of G are remapped to
+ * them, and labels only pruned vertices had are dropped from the pool.
+ */
+template <typename GRAPH_T>
+void PruneGraph(
+    boost::mpi::communicator& comm, GRAPH_T& gd, GRAPH_T& g,
+    const std::unordered_set<std::string>& g_source_labels,
+    std::vector<std::vector<std::pair<typename GRAPH_T::vertex_t, depth_t>>>&
+        g_descendants,
+    std::unordered_map<typename GRAPH_T::vertex_t,
+                       std::unordered_map<typename GRAPH_T::vertex_t,
+                                          edge_label_path_t>>& g_path,
+    int parallelism) {
+  using vertex_t = typename GRAPH_T::vertex_t;
+  SourceVertices<GRAPH_T> sources;
+  size_t n_vertices = g.Vertices().size();
+  size_t n_labels = g.label_dict().size();
+  size_t n_edges = 0, n_kept_edges = 0;
+
+  sources.Init(g, ResolveSourceLabels(g.label_dict(), g_source_labels));
+
+  auto keep = ReachableVertices(g, sources.vertices(), FLAGS_prune_depth,
+                                g_descendants);
+
+  for (auto v : g.Vertices()) {
+    n_edges += g.OutDegree(v);
+  }
+
+  auto new_ids = g.Compact(keep, parallelism);
+
+  if (!g_descendants.empty()) {
+    std::vector<std::vector<std::pair<vertex_t, depth_t>>> descendants(
+        g.Vertices().size());
+
+    for (vertex_t v = 0; v < n_vertices; v++) {
+      if (!keep[v]) {
+        continue;
+      }
+      for (auto& desc : g_descendants[v]) {
+        if (keep[desc.first]) {
+          descendants[new_ids[v]].emplace_back(new_ids[desc.first],
+                                               desc.second);
+        }
+      }
+    }
+    g_descendants.swap(descendants);
+  }
+
+  std::unordered_map<vertex_t, std::unordered_map<vertex_t, edge_label_path_t>>
+      path;
+
+  for (auto& src : g_path) {
+    if (!keep[src.first]) {
+      continue;
+    }
+    for (auto& dst : src.second) {
+      if (keep[dst.first]) {
+        path[new_ids[src.first]].emplace(new_ids[dst.first],
+                                         std::move(dst.second));
+      }
+    }
+  }
+  g_path.swap(path);
+
+  CompactLabelPool(gd, g);
+  for (auto v : g.Vertices()) {
+    n_kept_edges += g.OutDegree(v);
+  }
+
+  if (comm.rank() == 0) {
+    LOG(INFO) << "Pruned G: kept " << g.Vertices().size() << " of "
+              << n_vertices << " vertices, " << n_kept_edges << " of "
+              << n_edges << " edges, " << g.label_dict().size() << " of "
+              << n_labels << " labels";
+  }
+}
+
+/**
+ * Renumber the vertices of graph by method, see -reorder, and log how the
+ * distances between the ids of adjacent vertices change.
+ */
+template <typename GRAPH_T>
+void ReorderGraph(boost::mpi::communicator& comm, const std::string& name,
+                  GRAPH_T& graph, ReorderMethod method, int parallelism) {
+  if (method == ReorderMethod::kNone) {
+    return;
+  }
+
+  auto before = MeasureEdgeGaps(graph);
+
+  graph.Permute(ReorderVertices(graph, method, parallelism), parallelism);
+
+  auto after = MeasureEdgeGaps(graph);
+
+  if (comm.rank() == 0) {
+    LOG(INFO) << "Reordered " << name << " by " << FLAGS_reorder
+              << ": mean edge gap " << before.mean << " -> " << after.mean
+              << ", mean log2 edge gap " << before.mean_log2 << " -> "
+              << after.mean_log2;
+  }
+}
+
+/**
+ * Flag the ids of the edge labels of the comma separated list labels, as
+ * given by -flag. No flags are returned for an empty list, so traversals
+ * follow all edges.
+ */
+inline std::vector<bool> ResolveEdgeLabels(const LabelDictionary& dict,
+                                           const std::string& labels,
+                                           const std::string& flag) {
+  std::vector<bool> flags;
+  std::vector<std::string> names;
+
+  if (labels.empty()) {
+    return flags;
+  }
+  flags.resize(dict.size(), false);
+  boost::split(names, labels, boost::is_any_of(","), boost::token_compress_on);
+  for (auto& name : names) {
+    label_id_t id;
+
+    boost::trim(name);
+    // Edge labels are lower-cased when loaded
+    ToLowerAscii(&name[0], &name[0] + name.size());
+    if (name.empty()) {
+      continue;
+    }
+    if (dict.Find(name, id)) {
+      flags[id] = true;
+    } else {
+      LOG(WARNING) << "Unknown edge label in -" << flag << ": " << name;
+    }
+  }
+  return flags;
+}
+
+/**
+ * Group the out-edges of graph by label if traversals only follow the edge
+ * labels flagged by edge_labels, so they skip the others group by group.
+ */
+template <typename GRAPH_T>
+void GroupTraversedEdges(boost::mpi::communicator& comm,
+                         const std::string& name, GRAPH_T& graph,
+                         const std::vector<bool>& edge_labels,
+                         int parallelism) {
+  if (edge_labels.empty()) {
+    return;
+  }
+  graph.GroupEdgesByLabel(parallelism);
+  if (comm.rank() == 0) {
+    LOG(INFO) << "Traversals of " << name << " follow "
+              << std::count(edge_labels.begin(), edge_labels.end(), true)
+              << " of " << edge_labels.size() << " edge labels";
+  }
+}
+
+/**
+ * Compress the out-edges of graph, see -compress_g, unless they are compressed
+ * while loading, and log the bytes they take compared to a plain CSR.
+ */
+template <typename GRAPH_T>
+void CompressGraph(boost::mpi::communicator& comm, const std::string& name,
+                   GRAPH_T& graph, int parallelism) {
+  size_t n_edges = 0;
+
+  graph.CompressEdges(parallelism);
+  for (auto v : graph.Vertices()) {
+    n_edges += graph.OutDegree(v);
+  }
+
+  size_t bytes = (graph.Vertices().size() + 1) * sizeof(size_t) +
+                 n_edges * (sizeof(typename GRAPH_T::vid_t) +
+                            sizeof(typename GRAPH_T::edata_t));
+
+  if (comm.rank() == 0) {
+    LOG(INFO) << "Compressed the edges of " << name << ": " << bytes
+              << " -> " << graph.EdgeBytes() << " bytes, "
+              << static_cast<double>(graph.EdgeBytes()) /
+                     std::max<size_t>(n_edges, 1)
+              << " bytes per edge";
+  }
+}
+
+// Log the main facts of the statistics of a graph
+inline void LogGraphStats(const std::string& name, const GraphStats& stats) {
+  std::string descendants;
+
+  for (auto mean : stats.descendants) {
+    descendants += " " + std::to_string(mean);
+  }
+  LOG(INFO) << name << ": " << stats.n_vertices << " vertices, "
+            << stats.n_edges << " edges, mean out-degree "
+            << stats.MeanOutDegree() << ", max out-degree "
+            << stats.max_out_degree << ", " << stats.n_labels << " labels, "
+            << stats.n_sources << " source entities, mean descendants by "
+            << "depth:" << (descendants.empty() ? " -" : descendants);
+}
+
+// The tasks added by LoadData that later tasks may depend on
+struct LoadTasks {
+  TaskGraph::task_id_t gd;
+  TaskGraph::task_id_t g;
+  TaskGraph::task_id_t embedding;
+  TaskGraph::task_id_t source_labels;
+  // Loading the path data interns into the edge label dictionary of G
+  TaskGraph::task_id_t path;
+};
+
+/**
+ * Add the tasks loading the input files to tasks. GD and G share the label
+ * pool and the word dictionary of the loader, they are complete only after
+ * both graphs are loaded, and G is pruned if -prune_g is given.
+ */
 template <typename GRAPH_T, typename coord_t>
-void LoadData(
+LoadTasks LoadData(
     boost::mpi::communicator& comm, GRAPH_T& gd, GRAPH_T& g,
-    std::unordered_map<std::string, dense_vector_t<coord_t>>& word_embeddings,
+    WordEmbedding<coord_t>& word_embeddings,
     std::unordered_set<std::string>& gd_source_labels,
     std::unordered_set<std::string>& g_source_labels,
     std::unordered_map<std::pair<std::string, std::string>, coord_t>& synonym,
     std::vector<std::vector<std::pair<typename GRAPH_T::vertex_t, depth_t>>>&
         g_descendants,
-    std::unordered_map<
-        typename GRAPH_T::vertex_t,
-        std::unordered_map<typename GRAPH_T::vertex_t, std::string>>& g_path) {
-  using oid_t = typename GRAPH_T::oid_t;
-  using vertex_t = typename GRAPH_T::vertex_t;
-
-  GraphLoader<GRAPH_T> loader;
+    std::unordered_map<typename GRAPH_T::vertex_t,
+                       std::unordered_map<typename GRAPH_T::vertex_t,
+                                          edge_label_path_t>>& g_path,
+    std::shared_ptr<LabelDictionary> edge_label_dict, int parallelism,
+    TaskGraph& tasks) {
+  auto loader = std::make_shared<GraphLoader<GRAPH_T>>(
+      std::make_shared<LabelDictionary>(), edge_label_dict,
+      std::make_shared<LabelDictionary>(), FLAGS_map_vertex_labels);
   std::string gd_vfile = FLAGS_gd_vfile;
   std::string gd_efile = FLAGS_gd_efile;
   std::string g_vfile = FLAGS_g_vfile;
@@ -51,8 +568,6 @@ void LoadData(
   std::string synonym_file = FLAGS_synonym_file;
   std::string gd_slabel_file = FLAGS_gd_slabel_file;
   std::string g_slabel_file = FLAGS_g_slabel_file;
-  std::string desc_file = FLAGS_desc_file;
-  std::string path_file = FLAGS_path_file;
 
   if (access(gd_vfile.c_str(), 0) != 0) {
     LOG(FATAL) << "Invalid param: -gd_vfile = " << gd_vfile;
@@ -79,223 +594,393 @@ void LoadData(
   if (!synonym_file.empty() && access(synonym_file.c_str(), 0) != 0) {
     LOG(FATAL) << "Invalid param: -synonym_file = " << synonym_file;
   }
-  if (!desc_file.empty() && access(desc_file.c_str(), 0) != 0) {
-    LOG(FATAL) << "Invalid param: -desc_file = " << desc_file;
-  }
-  if (!path_file.empty() && access(path_file.c_str(), 0) != 0) {
-    LOG(FATAL) << "Invalid param: -path_file = " << path_file;
-  }
-
-  std::thread load_gd_thread(
-      [&loader, &gd](const std::string& vfile, const std::string& efile) {
-        gd = loader.LoadGraph(vfile, efile);
 
-        for (auto v : gd.Vertices()) {
-          boost::to_lower(gd[v]);
+  ReorderMethod reorder;
 
-          for (auto& e : gd.GetOutgoingAdjList(v)) {
-            boost::to_lower(gd[e]);
-          }
-        }
-      },
-      gd_vfile, gd_efile);
-
-  std::thread load_g_thread(
-      [&loader, &g](const std::string& vfile, const std::string& efile) {
-        g = loader.LoadGraph(vfile, efile);
-
-        for (auto v : g.Vertices()) {
-          boost::to_lower(g[v]);
+  if (!ParseReorderMethod(FLAGS_reorder, reorder)) {
+    LOG(FATAL) << "Invalid param: -reorder = " << FLAGS_reorder;
+  }
 
-          for (auto& e : g.GetOutgoingAdjList(v)) {
-            boost::to_lower(g[e]);
-          }
+  LoadTasks ids;
+  // Rows of G are coded straight from the parsed edges, unless G is changed
+  // after loading
+  bool compress_g = FLAGS_compress_g && reorder == ReorderMethod::kNone &&
+                    !FLAGS_prune_g && FLAGS_g_delta_file.empty();
+
+  // Graphs are reordered before anything refers to their vertex ids
+  ids.gd = tasks.AddTask(
+      "Load GD", [&comm, loader, &gd, gd_vfile, gd_efile, reorder,
+                  parallelism]() {
+        gd = loader->LoadGraph(gd_vfile, gd_efile, parallelism);
+        ReorderGraph(comm, "GD", gd, reorder, parallelism);
+      });
+
+  ids.g = tasks.AddTask(
+      "Load G",
+      [&comm, loader, &g, g_vfile, g_efile, reorder, parallelism,
+       compress_g]() {
+        g = loader->LoadGraph(g_vfile, g_efile, parallelism, compress_g);
+        ReorderGraph(comm, "G", g, reorder, parallelism);
+      });
+
+  auto synonym_task =
+      tasks.AddTask("Load synonyms", [&comm, &synonym, synonym_file]() {
+        if (synonym_file.empty()) {
+          return;
         }
-      },
-      g_vfile, g_efile);
 
-  std::thread load_embedding_thread(
-      [&comm, &word_embeddings](const std::string& embedding_file) {
-        std::ifstream fi(embedding_file);
+        LineReader fi(synonym_file);
         std::string line;
-        size_t last_dim = 0;
-
-        while (getline(fi, line)) {
-          std::istringstream iss(line);
-          std::string word;
 
-          iss >> word;
+        while (fi.GetLine(line)) {
+          std::string word_a, word_b;
+          coord_t score;
 
-          boost::to_lower(word);
+          std::vector<std::string> words;
+          boost::split(words, line, boost::is_any_of(","),
+                       boost::token_compress_on);
 
-          coord_t val;
-          auto& vec = word_embeddings[word];
-          std::vector<coord_t> tmp;
+          CHECK_EQ(words.size(), 3) << "Bad line: " << line;
 
-          while (iss >> val) {
-            tmp.push_back(val);
-          }
+          word_a = words[0];
+          word_b = words[1];
+          score = std::stof(words[2]);
 
-          if (last_dim == 0) {
-            last_dim = tmp.size();
-          }
-          vec.resize(last_dim);
+          CHECK_GT(score, 0) << "Bad line: " << line;
+          CHECK_LE(score, 1) << "Bad line: " << line;
 
-          for (size_t i = 0; i < last_dim; i++) {
-            vec[i] = tmp[i];
-          }
-          if (last_dim == 0) {
-            last_dim = vec.size();
-          } else {
-            CHECK_EQ(last_dim, vec.size())
-                << "Bad word vector: seen unmatched dim " << last_dim << " vs "
-                << vec.size();
-          }
+          boost::to_lower(word_a);
+          boost::to_lower(word_b);
+          synonym.template emplace(std::make_pair(word_a, word_b), score);
+          synonym.template emplace(std::make_pair(word_b, word_a), score);
         }
 
-        fi.close();
         if (comm.rank() == 0) {
-          LOG(INFO) << "Rank: " << comm.rank() << " Loaded " << embedding_file
-                    << ": " << word_embeddings.size() << " words";
+          LOG(INFO) << "Loaded " << synonym_file << ": " << synonym.size()
+                    << " words";
         }
-      },
-      word_embedding_file);
+      });
 
-  if (!synonym_file.empty()) {
-    std::ifstream fi(synonym_file);
-    std::string line;
+  ids.source_labels = tasks.AddTask(
+      "Load source labels",
+      [&gd_source_labels, &g_source_labels, gd_slabel_file, g_slabel_file]() {
+        {
+          LineReader fi(gd_slabel_file);
+          std::string line;
 
-    while (getline(fi, line)) {
-      std::string word_a, word_b;
-      coord_t score;
+          while (fi.GetLine(line)) {
+            boost::to_lower(line);
 
-      std::vector<std::string> words;
-      boost::split(words, line, boost::is_any_of(","),
-                   boost::token_compress_on);
+            gd_source_labels.insert(line);
+          }
+        }
+        {
+          LineReader fi(g_slabel_file);
+          std::string line;
 
-      CHECK_EQ(words.size(), 3) << "Bad line: " << line;
+          while (fi.GetLine(line)) {
+            boost::to_lower(line);
 
-      word_a = words[0];
-      word_b = words[1];
-      score = std::stof(words[2]);
+            g_source_labels.insert(line);
+          }
+        }
+      });
 
-      CHECK_GT(score, 0) << "Bad line: " << line;
-      CHECK_LE(score, 1) << "Bad line: " << line;
+  // Both graphs intern into the edge label dictionary as well
+  ids.path = tasks.AddTask(
+      "Load path data",
+      [&comm, &g, edge_label_dict, &g_descendants, &g_path]() {
+        LoadPathData(comm, g, *edge_label_dict, g_descendants, g_path);
+      },
+      {ids.gd, ids.g});
+
+  if (FLAGS_prune_g) {
+    // Pruning changes the ids of G and the labels of both graphs, so GD and G
+    // are complete only after it
+    ids.gd = ids.g = tasks.AddTask(
+        "Prune G",
+        [&comm, &gd, &g, &g_source_labels, &g_descendants, &g_path,
+         parallelism]() {
+          PruneGraph(comm, gd, g, g_source_labels, g_descendants, g_path,
+                     parallelism);
+        },
+        {ids.gd, ids.g, ids.source_labels, ids.path});
+  }
 
-      boost::to_lower(word_a);
-      boost::to_lower(word_b);
-      synonym.template emplace(std::make_pair(word_a, word_b), score);
-      synonym.template emplace(std::make_pair(word_b, word_a), score);
-    }
+  if (FLAGS_prune_embedding) {
+    // Pruning needs every word that may be looked up
+    ids.embedding = tasks.AddTask(
+        "Load embedding",
+        [&comm, &g, edge_label_dict, &synonym, &word_embeddings,
+         word_embedding_file, parallelism]() {
+          auto vocabulary =
+              BuildVocabulary(g.word_dict(), *edge_label_dict, synonym);
+
+          CollectDeltaWords<typename GRAPH_T::oid_t>(vocabulary);
+          LoadWordEmbedding(comm, word_embedding_file, &vocabulary,
+                            parallelism, word_embeddings);
+        },
+        {ids.gd, ids.g, synonym_task, ids.path});
+  } else {
+    ids.embedding = tasks.AddTask(
+        "Load embedding",
+        [&comm, &word_embeddings, word_embedding_file, parallelism]() {
+          LoadWordEmbedding(comm, word_embedding_file, nullptr, parallelism,
+                            word_embeddings);
+        });
+  }
+  return ids;
+}
 
-    fi.close();
-    if (comm.rank() == 0) {
-      LOG(INFO) << "Loaded " << synonym_file << ": " << synonym.size()
-                << " words";
+/**
+ * Translate the synonym between words into synonym between ids of the label
+ * pool of GD and G, so that h_v looks them up without touching strings.
+ */
+template <typename coord_t>
+std::unordered_map<std::pair<label_id_t, label_id_t>, coord_t> ResolveSynonym(
+    const LabelDictionary& label_dict,
+    const std::unordered_map<std::pair<std::string, std::string>, coord_t>&
+        synonym) {
+  std::unordered_map<std::pair<label_id_t, label_id_t>, coord_t>
+      label_synonym;
+
+  for (auto& pair : synonym) {
+    label_id_t u_label, v_label;
+
+    if (label_dict.Find(pair.first.first, u_label) &&
+        label_dict.Find(pair.first.second, v_label)) {
+      label_synonym.emplace(std::make_pair(u_label, v_label), pair.second);
     }
   }
+  return label_synonym;
+}
 
-  load_gd_thread.join();
-  load_g_thread.join();
-  load_embedding_thread.join();
-
-  {
-    std::ifstream fi(gd_slabel_file);
-    std::string line;
-
-    while (getline(fi, line)) {
-      boost::to_lower(line);
-
-      gd_source_labels.insert(line);
+/**
+ * Translate the synonym between words into synonym between paths. A word is
+ * taken as a path of the space separated edge labels it consists of, words
+ * with a label that is not in the edge label table are skipped.
+ */
+template <typename coord_t>
+std::unordered_map<std::pair<edge_label_path_t, edge_label_path_t>, coord_t,
+                   EdgeLabelPathPairHash>
+ResolvePathSynonym(
+    const LabelDictionary& edge_label_dict,
+    const std::unordered_map<std::pair<std::string, std::string>, coord_t>&
+        synonym) {
+  std::unordered_map<std::pair<edge_label_path_t, edge_label_path_t>, coord_t,
+                     EdgeLabelPathPairHash>
+      path_synonym;
+  auto to_path = [&edge_label_dict](const std::string& text,
+                                    edge_label_path_t& path) {
+    std::vector<std::string> labels;
+
+    boost::split(labels, text, boost::is_any_of(" "),
+                 boost::token_compress_on);
+    for (auto& label : labels) {
+      label_id_t id;
+
+      if (!label.empty()) {
+        if (!edge_label_dict.Find(label, id)) {
+          return false;
+        }
+        path.push_back(id);
+      }
     }
-    fi.close();
-  }
-  {
-    std::ifstream fi(g_slabel_file);
-    std::string line;
+    return !path.empty();
+  };
 
-    while (getline(fi, line)) {
-      boost::to_lower(line);
+  for (auto& pair : synonym) {
+    edge_label_path_t path_a, path_b;
 
-      g_source_labels.insert(line);
+    if (to_path(pair.first.first, path_a) &&
+        to_path(pair.first.second, path_b)) {
+      path_synonym.emplace(std::make_pair(path_a, path_b), pair.second);
     }
-    fi.close();
   }
-  auto vm_ptr = g.vertex_map();
-
-  if (!desc_file.empty()) {
-    std::ifstream fi(desc_file);
-    std::string line;
-    size_t n_desc = 0;
-
-    g_descendants.resize(g.Vertices().size());
+  return path_synonym;
+}
 
-    while (getline(fi, line)) {
-      std::istringstream iss(line);
-      oid_t v_oid;
-      depth_t depth;
-      vertex_t v;
+/**
+ * Apply the delta files of -g_delta_file to G in the given order. Only the
+ * state derived from the touched vertices is updated: the postings of the
+ * inverted index and the source vertices, and the source label flags and the
+ * vectors of new labels. The descendants and paths of G are loaded again.
+ */
+template <typename GRAPH_T, typename coord_t>
+void ApplyGraphDelta(
+    boost::mpi::communicator& comm, GRAPH_T& g,
+    const WordEmbedding<coord_t>& word_embedding,
+    const std::unordered_set<std::string>& g_source_labels,
+    std::vector<bool>& g_source_label_flags,
+    SourceVertices<GRAPH_T>& g_source_vertices,
+    VectorTable<coord_t>& label_vector,
+    InvertedIndex<GRAPH_T>& inverted_index,
+    std::vector<std::vector<std::pair<typename GRAPH_T::vertex_t, depth_t>>>&
+        g_descendants,
+    std::unordered_map<typename GRAPH_T::vertex_t,
+                       std::unordered_map<typename GRAPH_T::vertex_t,
+                                          edge_label_path_t>>& g_path) {
+  for (auto& delta_file : DeltaFiles()) {
+    GraphDelta<typename GRAPH_T::oid_t> delta;
+    auto begin = GetCurrentTime();
 
-      iss >> v_oid;
+    delta.Load(delta_file);
 
-      if (vm_ptr->HasOid(v_oid)) {
-        CHECK(g.GetVertex(v_oid, v))
-            << "Failed to get vertex with id: " << v_oid;
-        auto& descendants = g_descendants[v];
+    auto update = g.ApplyDelta(delta);
 
-        while (iss >> v_oid >> depth) {
-          if (vm_ptr->HasOid(v_oid)) {
-            CHECK(g.GetVertex(v_oid, v))
-                << "Failed to get descendant with id: " << v_oid;
-            descendants.emplace_back(v, depth);
-            n_desc++;
-          }
-        }
-      }
-    }
+    g_source_label_flags = ResolveSourceLabels(g.label_dict(), g_source_labels);
+    g_source_vertices.Update(g, g_source_label_flags, update);
+    ExtendLabelVector(g, word_embedding, label_vector);
+    inverted_index.Update(g, g_source_label_flags, update);
 
     if (comm.rank() == 0) {
-      LOG(INFO) << "Read " << n_desc << " descendants";
+      LOG(INFO) << "Applied " << delta_file << ": " << delta.size()
+                << " changes, " << update.n_added_vertices
+                << " vertices added, " << update.n_removed_vertices
+                << " vertices removed, "
+                << update.n_added_edges << " edges added, "
+                << update.n_removed_edges << " edges removed, "
+                << update.vertices.size() << " vertices touched in "
+                << GetCurrentTime() - begin << " s";
     }
-    fi.close();
   }
 
-  if (!path_file.empty()) {
-    std::ifstream fi(path_file);
-    std::string line;
-    size_t n_path = 0;
+  // The descendants and paths may refer to vertices added by the deltas
+  g_descendants.clear();
+  g_path.clear();
+  LoadPathData(comm, g, *g.edge_label_dict_ptr(), g_descendants, g_path);
+}
 
-    while (getline(fi, line)) {
-      std::istringstream iss(line);
-      oid_t v1_oid, v2_oid;
-      vertex_t v1, v2;
-      std::string path_labels;
+/**
+ * Write the state prepared by LoadData, FillLabelVector,
+ * InvertedIndex::Init and ComputeGraphStats into a snapshot file.
+ */
+template <typename GRAPH_T, typename coord_t>
+void WriteSnapshot(
+    const std::string& path, const GRAPH_T& gd, const GRAPH_T& g,
+    const WordEmbedding<coord_t>& word_embeddings,
+    const std::unordered_set<std::string>& gd_source_labels,
+    const std::unordered_set<std::string>& g_source_labels,
+    const std::unordered_map<std::pair<std::string, std::string>, coord_t>&
+        synonym,
+    const VectorTable<coord_t>& label_vector,
+    const InvertedIndex<GRAPH_T>& inverted_index, const GraphCatalog& catalog,
+    bool g_pruned, bool embedding_pruned) {
+  SnapshotWriter writer(path);
+
+  writer.WritePod<uint32_t>(sizeof(typename GRAPH_T::oid_t));
+  writer.WritePod<uint32_t>(sizeof(typename GRAPH_T::vid_t));
+  writer.WritePod<uint32_t>(sizeof(coord_t));
+  writer.WritePod<uint8_t>(g_pruned);
+  writer.WritePod<uint8_t>(embedding_pruned);
+
+  // GD and G share the label pool, the edge label table and the word
+  // dictionary
+  gd.label_dict().Serialize(writer);
+  gd.label_tokens().Serialize(writer);
+  gd.edge_label_dict().Serialize(writer);
+  gd.word_dict().Serialize(writer);
+  gd.Serialize(writer);
+  g.Serialize(writer);
+
+  label_vector.Serialize(writer);
+  word_embeddings.Serialize(writer);
+
+  writer.WriteStrings(gd_source_labels);
+  writer.WriteStrings(g_source_labels);
 
-      iss >> v1_oid;
-      iss >> v2_oid;
-      iss >> path_labels;
+  {
+    std::vector<std::string> words_a, words_b;
+    std::vector<coord_t> scores;
 
-      boost::to_lower(path_labels);
+    for (auto& pair : synonym) {
+      words_a.push_back(pair.first.first);
+      words_b.push_back(pair.first.second);
+      scores.push_back(pair.second);
+    }
+    writer.WriteStrings(words_a);
+    writer.WriteStrings(words_b);
+    writer.WriteVector(scores);
+  }
+
+  inverted_index.Serialize(writer);
+  catalog.Serialize(writer);
+  writer.Close();
+}
 
-      std::replace(path_labels.begin(), path_labels.end(), ';', ' ');
-      std::replace(path_labels.begin(), path_labels.end(), ',', ' ');
+/**
+ * The path of the snapshot shared by the ranks of node_comm, it is named
+ * after the process of the node leader.
+ */
+inline std::string NodeSnapshotPath(boost::mpi::communicator& node_comm) {
+  int leader_pid = getpid();
 
-      if (vm_ptr->HasOid(v1_oid) && vm_ptr->HasOid(v2_oid)) {
-        CHECK(g.GetVertex(v1_oid, v1))
-            << "Failed to get vertex v1 with id: " << v1_oid;
-        CHECK(g.GetVertex(v2_oid, v2))
-            << "Failed to get vertex v2 with id: " << v2_oid;
+  boost::mpi::broadcast(node_comm, leader_pid, 0);
+  return FLAGS_node_snapshot_dir + "/her-" + std::to_string(leader_pid) +
+         ".snapshot";
+}
 
-        g_path[v1][v2] = path_labels;
-        n_path++;
-      }
-    }
+template <typename GRAPH_T, typename coord_t>
+void ReadSnapshot(
+    const std::string& path, GRAPH_T& gd, GRAPH_T& g,
+    WordEmbedding<coord_t>& word_embeddings,
+    std::unordered_set<std::string>& gd_source_labels,
+    std::unordered_set<std::string>& g_source_labels,
+    std::unordered_map<std::pair<std::string, std::string>, coord_t>& synonym,
+    VectorTable<coord_t>& label_vector, InvertedIndex<GRAPH_T>& inverted_index,
+    GraphCatalog& catalog, bool& g_pruned, bool& embedding_pruned) {
+  SnapshotReader reader(path);
+
+  CHECK(reader.ReadPod<uint32_t>() == sizeof(typename GRAPH_T::oid_t) &&
+        reader.ReadPod<uint32_t>() == sizeof(typename GRAPH_T::vid_t) &&
+        reader.ReadPod<uint32_t>() == sizeof(coord_t))
+      << "Snapshot " << path << " was written with different types";
+  g_pruned = reader.ReadPod<uint8_t>() != 0;
+  embedding_pruned = reader.ReadPod<uint8_t>() != 0;
+
+  auto label_dict = std::make_shared<LabelDictionary>();
+  auto label_tokens = std::make_shared<TokenTable>();
+  auto edge_label_dict = std::make_shared<LabelDictionary>();
+  auto word_dict = std::make_shared<LabelDictionary>();
+
+  label_dict->Deserialize(reader);
+  label_tokens->Deserialize(reader);
+  CHECK_EQ(label_tokens->size(), label_dict->size()) << "Corrupted snapshot";
+  edge_label_dict->Deserialize(reader);
+  word_dict->Deserialize(reader);
+  gd.Deserialize(reader, label_dict, label_tokens, edge_label_dict, word_dict);
+  g.Deserialize(reader, label_dict, label_tokens, edge_label_dict, word_dict);
+
+  label_vector.Deserialize(reader);
+  CHECK_EQ(label_vector.size(), label_dict->size()) << "Corrupted snapshot";
+  word_embeddings.Deserialize(reader);
+
+  for (auto* source_labels : {&gd_source_labels, &g_source_labels}) {
+    std::vector<std::string> labels;
+
+    reader.ReadStrings(labels);
+    source_labels->clear();
+    source_labels->insert(labels.begin(), labels.end());
+  }
 
-    if (comm.rank() == 0) {
-      LOG(INFO) << "Read " << n_path << " paths";
+  {
+    std::vector<std::string> words_a, words_b;
+    std::vector<coord_t> scores;
+
+    reader.ReadStrings(words_a);
+    reader.ReadStrings(words_b);
+    reader.ReadVector(scores);
+    CHECK(words_a.size() == words_b.size() && words_a.size() == scores.size())
+        << "Corrupted snapshot";
+    synonym.clear();
+    for (size_t i = 0; i < scores.size(); i++) {
+      synonym.emplace(std::make_pair(words_a[i], words_b[i]), scores[i]);
     }
-    fi.close();
   }
+
+  inverted_index.Deserialize(reader);
+  catalog.Deserialize(reader);
+  CHECK(reader.AtEnd()) << "Unexpected trailing data in snapshot " << path;
 }
 
 template <typename GRAPH_T, typename H_V, typename H_P, typename H_R>
@@ -306,9 +991,13 @@ bool SPairQuery(GRAPH_T& gd, GRAPH_T& g, H_V& h_v, H_P& h_p, H_R& h_r) {
   double sigma = FLAGS_sigma;
   double delta = FLAGS_delta;
   int k = FLAGS_k;
-  oid_t u_oid = FLAGS_vertex_u, v_oid = FLAGS_vertex_v;
+  oid_t u_oid, v_oid;
   vertex_t u, v;
 
+  CHECK(ParseOid(FLAGS_vertex_u, u_oid))
+      << "Invalid param: -vertex_u = " << FLAGS_vertex_u;
+  CHECK(ParseOid(FLAGS_vertex_v, v_oid))
+      << "Invalid param: -vertex_v = " << FLAGS_vertex_v;
   CHECK(gd.GetVertex(u_oid, u))
       << "Can not found vertex " << u_oid << " from graph GD";
   CHECK(g.GetVertex(v_oid, v))
@@ -331,9 +1020,11 @@ std::vector<typename GRAPH_T::vertex_t> VPairQuery(GRAPH_T& gd, GRAPH_T& g,
   double sigma = FLAGS_sigma;
   double delta = FLAGS_delta;
   int k = FLAGS_k;
-  oid_t u_oid = FLAGS_vertex_u;
+  oid_t u_oid;
   vertex_t u;
 
+  CHECK(ParseOid(FLAGS_vertex_u, u_oid))
+      << "Invalid param: -vertex_u = " << FLAGS_vertex_u;
   CHECK(gd.GetVertex(u_oid, u))
       << "Can not found vertex " << u_oid << " from graph GD";
 
@@ -348,28 +1039,45 @@ template <typename GRAPH_T, typename H_V, typename H_P, typename H_R,
           typename coord_t>
 std::vector<VertexPair<typename GRAPH_T::vertex_t>> APairQuery(
     GRAPH_T& gd, GRAPH_T& g, H_V& h_v, H_P& h_p, H_R& h_r,
-    const VertexArray<dense_vector_t<coord_t>, GRAPH_T>& gd_label_vector,
-    const VertexArray<dense_vector_t<coord_t>, GRAPH_T>& g_label_vector,
-    const std::unordered_set<std::string>& gd_source_labels,
-    const std::unordered_set<std::string>& g_source_labels,
+    const VectorTable<coord_t>& label_vector,
+    const SourceVertices<GRAPH_T>& gd_source_vertices,
+    const SourceVertices<GRAPH_T>& g_source_vertices,
     const InvertedIndex<GRAPH_T>& inverted_index, int parallelism) {
   double sigma = FLAGS_sigma;
   double delta = FLAGS_delta;
   int k = FLAGS_k;
 
   APairParallel<GRAPH_T, coord_t, H_V, H_P, H_R> a_pair(
-      gd, g, h_v, h_p, h_r, gd_source_labels, g_source_labels, inverted_index);
+      gd, g, h_v, h_p, h_r, gd_source_vertices, g_source_vertices,
+      inverted_index);
 
   a_pair.InitParams(sigma, delta, k, parallelism);
 
   return a_pair.Query();
 }
 
+/**
+ * A pruned G lacks the vertices APair never reaches, other queries and deltas
+ * may refer to them.
+ */
+inline void CheckPrunedGraph(bool g_pruned) {
+  if (!g_pruned) {
+    return;
+  }
+  if (FLAGS_query_type != "apair") {
+    LOG(FATAL) << "A pruned G only supports -query_type apair";
+  }
+  if (!FLAGS_g_delta_file.empty()) {
+    LOG(FATAL) << "Deltas can not be applied to a pruned G";
+  }
+}
+
+template <typename OID_T>
 void RunApp() {
-  using oid_t = int32_t;
+  using oid_t = OID_T;
   using vid_t = uint32_t;
-  using vdata_t = std::string;
-  using edata_t = std::string;
+  using vdata_t = label_id_t;
+  using edata_t = edge_label_id_t;
   using graph_t = Graph<oid_t, vid_t, vdata_t, edata_t>;
   using vertex_t = typename graph_t::vertex_t;
   using coord_t = float;
@@ -377,62 +1085,270 @@ void RunApp() {
 
   boost::mpi::communicator comm;
   graph_t gd, g;
-  std::unordered_map<std::string, dense_vector_t<coord_t>> word_embedding;
+  WordEmbedding<coord_t> word_embedding;
   std::unordered_set<std::string> gd_source_labels, g_source_labels;
   std::unordered_map<std::pair<std::string, std::string>, coord_t> synonym;
+  std::vector<bool> gd_source_label_flags, g_source_label_flags;
+  SourceVertices<graph_t> gd_source_vertices, g_source_vertices;
+  std::unordered_map<std::pair<label_id_t, label_id_t>, coord_t> label_synonym;
   std::vector<std::vector<std::pair<vertex_t, depth_t>>> g_descendants;
-  std::unordered_map<vertex_t, std::unordered_map<vertex_t, std::string>>
+  std::unordered_map<vertex_t, std::unordered_map<vertex_t, edge_label_path_t>>
       g_path;
+  auto edge_label_dict = std::make_shared<LabelDictionary>();
+  TokenTable edge_label_tokens;
+  std::vector<point_t> edge_label_vector_sum;
+  std::vector<size_t> edge_label_word_count;
+  std::unordered_map<std::pair<edge_label_path_t, edge_label_path_t>, coord_t,
+                     EdgeLabelPathPairHash>
+      path_synonym;
   InvertedIndex<graph_t> inverted_index;
-  VertexArray<point_t, graph_t> gd_label_vector;
-  VertexArray<point_t, graph_t> g_label_vector;
+  VectorTable<coord_t> label_vector;
+  GraphCatalog catalog;
+  bool g_pruned = FLAGS_prune_g && FLAGS_snapshot_in.empty();
+  bool embedding_pruned = FLAGS_prune_embedding && FLAGS_snapshot_in.empty();
   int parallelism = GetParallelism(comm);
+  auto compute_stats = [parallelism](const graph_t& graph,
+                                     const SourceVertices<graph_t>& sources) {
+    return ComputeGraphStats(graph, sources, FLAGS_bfs_depth,
+                             std::max(FLAGS_stats_sources, 0), parallelism);
+  };
+
+  CheckPrunedGraph(g_pruned);
+  SetLargeArrayPolicy();
 
   LOG(INFO) << "Rank: " << comm.rank() << " thread num: " << parallelism;
 
   timer_start(comm.rank() == 0);
-  timer_next("Load Data");
 
-  LoadData(comm, gd, g, word_embedding, gd_source_labels, g_source_labels,
-           synonym, g_descendants, g_path);
+  std::vector<bool> gd_edge_labels, g_edge_labels;
+  auto resolve_edge_labels = [&]() {
+    gd_edge_labels =
+        ResolveEdgeLabels(*edge_label_dict, FLAGS_gd_traverse_edge_labels,
+                          "gd_traverse_edge_labels");
+    g_edge_labels =
+        ResolveEdgeLabels(*edge_label_dict, FLAGS_g_traverse_edge_labels,
+                          "g_traverse_edge_labels");
+  };
+  // Rows are grouped after -snapshot_out is written, so it keeps the loaded
+  // order of the edges. Compressed rows are sorted by target, so they are
+  // not grouped
+  auto group_edges = [&]() {
+    GroupTraversedEdges(comm, "GD", gd, gd_edge_labels, parallelism);
+    if (!g.EdgesCompressed()) {
+      GroupTraversedEdges(comm, "G", g, g_edge_labels, parallelism);
+    }
+  };
+
+  std::string snapshot_in = FLAGS_snapshot_in;
+  bool share_node_memory = FLAGS_share_node_memory && snapshot_in.empty();
+  boost::mpi::communicator node_comm;
+
+  // The node leader prepares the state and writes it to a snapshot in shared
+  // memory, all ranks of the node then map that snapshot
+  if (share_node_memory) {
+    node_comm = NodeCommunicator(comm);
+    snapshot_in = NodeSnapshotPath(node_comm);
+  }
+
+  if (FLAGS_snapshot_in.empty() &&
+      (!share_node_memory || node_comm.rank() == 0)) {
+    TaskGraph tasks;
+
+    timer_next("Prepare");
+
+    auto load = LoadData(comm, gd, g, word_embedding, gd_source_labels,
+                         g_source_labels, synonym, g_descendants, g_path,
+                         edge_label_dict, parallelism, tasks);
+    auto resolve_task = tasks.AddTask(
+        "Resolve source vertices",
+        [&]() {
+          gd_source_label_flags =
+              ResolveSourceLabels(gd.label_dict(), gd_source_labels);
+          g_source_label_flags =
+              ResolveSourceLabels(g.label_dict(), g_source_labels);
+          gd_source_vertices.Init(gd, gd_source_label_flags);
+          g_source_vertices.Init(g, g_source_label_flags);
+        },
+        {load.gd, load.g, load.source_labels});
+
+    tasks.AddTask(
+        "Fill label vector",
+        [&]() {
+          FillLabelVector(g, word_embedding, label_vector, parallelism);
+        },
+        {load.gd, load.g, load.embedding});
+    // The index only needs G, so it is built while the embedding is loaded
+    tasks.AddTask(
+        "Init inverted index",
+        [&]() { inverted_index.Init(g, g_source_vertices); },
+        {load.g, resolve_task});
+    tasks.AddTask(
+        "Compute statistics",
+        [&]() {
+          catalog.gd = compute_stats(gd, gd_source_vertices);
+          catalog.g = compute_stats(g, g_source_vertices);
+        },
+        {load.gd, load.g, load.path, resolve_task});
+
+    // The tasks and their parallel loops share parallelism workers
+    tasks.Run(parallelism);
+    for (auto& task : tasks.tasks()) {
+      timer_next(task.name, task.end - task.start);
+    }
+    if (comm.rank() == 0) {
+      tasks.LogTiming("Prepare");
+    }
+
+    if (!FLAGS_g_delta_file.empty()) {
+      timer_next("Apply delta");
+      ApplyGraphDelta(comm, g, word_embedding, g_source_labels,
+                      g_source_label_flags, g_source_vertices, label_vector,
+                      inverted_index, g_descendants, g_path);
+      catalog.g = compute_stats(g, g_source_vertices);
+    }
+    if (FLAGS_compress_g) {
+      CompressGraph(comm, "G", g, parallelism);
+    }
 
-  timer_next("Filling word vector");
-  FillWordVector(gd, word_embedding, gd_label_vector, parallelism);
-  FillWordVector(g, word_embedding, g_label_vector, parallelism);
+    if (!FLAGS_snapshot_out.empty() && comm.rank() == 0) {
+      timer_next("Write snapshot");
+      WriteSnapshot(FLAGS_snapshot_out, gd, g, word_embedding,
+                    gd_source_labels, g_source_labels, synonym, label_vector,
+                    inverted_index, catalog, g_pruned, embedding_pruned);
+      LOG(INFO) << "Wrote snapshot " << FLAGS_snapshot_out;
+    }
+    // The ranks of the node map the grouped or compressed rows of the node
+    // snapshot
+    resolve_edge_labels();
+    group_edges();
+    if (share_node_memory) {
+      timer_next("Write node snapshot");
+      WriteSnapshot(snapshot_in, gd, g, word_embedding, gd_source_labels,
+                    g_source_labels, synonym, label_vector, inverted_index,
+                    catalog, g_pruned, embedding_pruned);
+    }
+  }
 
-  timer_next("Init inverted index");
-  inverted_index.Init(g, g_source_labels);
+  if (share_node_memory) {
+    node_comm.barrier();
+  }
+
+  if (!snapshot_in.empty()) {
+    timer_next("Load snapshot");
+
+    ReadSnapshot(snapshot_in, gd, g, word_embedding, gd_source_labels,
+                 g_source_labels, synonym, label_vector, inverted_index,
+                 catalog, g_pruned, embedding_pruned);
+    CheckPrunedGraph(g_pruned);
+    edge_label_dict = g.edge_label_dict_ptr();
+    // The node leader has loaded the path data already
+    g_descendants.clear();
+    g_path.clear();
+    LoadPathData(comm, g, *edge_label_dict, g_descendants, g_path);
+    gd_source_label_flags =
+        ResolveSourceLabels(gd.label_dict(), gd_source_labels);
+    g_source_label_flags = ResolveSourceLabels(g.label_dict(), g_source_labels);
+    gd_source_vertices.Init(gd, gd_source_label_flags);
+    g_source_vertices.Init(g, g_source_label_flags);
+
+    // A node snapshot already has the deltas applied and the rows grouped or
+    // compressed
+    if (!FLAGS_snapshot_in.empty()) {
+      if (!FLAGS_g_delta_file.empty()) {
+        // Words that only the labels of the deltas have were pruned
+        if (embedding_pruned) {
+          LOG(FATAL) << "Deltas can not be applied to a snapshot whose "
+                        "embedding is pruned";
+        }
+        timer_next("Apply delta");
+        ApplyGraphDelta(comm, g, word_embedding, g_source_labels,
+                        g_source_label_flags, g_source_vertices, label_vector,
+                        inverted_index, g_descendants, g_path);
+        catalog.g = compute_stats(g, g_source_vertices);
+      }
+      if (FLAGS_compress_g) {
+        CompressGraph(comm, "G", g, parallelism);
+      }
+      if (!FLAGS_g_delta_file.empty() && !FLAGS_snapshot_out.empty() &&
+          comm.rank() == 0) {
+        timer_next("Write snapshot");
+        WriteSnapshot(FLAGS_snapshot_out, gd, g, word_embedding,
+                      gd_source_labels, g_source_labels, synonym, label_vector,
+                      inverted_index, catalog, g_pruned, embedding_pruned);
+        LOG(INFO) << "Wrote snapshot " << FLAGS_snapshot_out;
+      }
+      resolve_edge_labels();
+      group_edges();
+    } else if (node_comm.rank() != 0) {
+      resolve_edge_labels();
+    }
+  }
+
+  if (share_node_memory) {
+    // Mappings stay valid after the file is removed
+    node_comm.barrier();
+    if (node_comm.rank() == 0) {
+      unlink(snapshot_in.c_str());
+      LOG(INFO) << "Rank: " << comm.rank() << " shared the prepared state "
+                << "with " << node_comm.size() - 1 << " ranks on the node";
+    }
+  }
+
+
+  label_synonym = ResolveSynonym(g.label_dict(), synonym);
+  path_synonym = ResolvePathSynonym(*edge_label_dict, synonym);
+  // Edge labels of the path file are only known now
+  edge_label_tokens.Tokenize(*edge_label_dict, *g.word_dict_ptr());
+  FillEdgeLabelVector(edge_label_tokens, g.word_dict(), word_embedding,
+                      edge_label_vector_sum, edge_label_word_count);
+
+  if (comm.rank() == 0) {
+    LogGraphStats("GD", catalog.gd);
+    LogGraphStats("G", catalog.g);
+    if (!FLAGS_stats_file.empty()) {
+      WriteGraphCatalogJson(FLAGS_stats_file, catalog, gd, g);
+      LOG(INFO) << "Wrote statistics " << FLAGS_stats_file;
+    }
+  }
+
+  // Arrays used in place from a snapshot are not large arrays, their pages
+  // are placed by the page cache
+  if (FLAGS_huge_pages != "none" || FLAGS_numa_policy != "local" ||
+      VLOG_IS_ON(1)) {
+    LOG(INFO) << "Rank: " << comm.rank()
+              << " large arrays: " << LargeArrayReport();
+  }
 
   comm.barrier();
 
-  auto h_v = [&gd_label_vector, &g_label_vector, &synonym](
-                 graph_t& gd, vertex_t u, graph_t& g, vertex_t v) -> coord_t {
-    auto& u_label = gd[u];
-    auto& v_label = g[v];
+  // GD and G share the label pool, equal labels have equal ids
+  auto h_v = [&label_vector, &label_synonym](graph_t& gd, vertex_t u,
+                                             graph_t& g,
+                                             vertex_t v) -> coord_t {
+    auto u_label = gd[u];
+    auto v_label = g[v];
 
     if (u_label == v_label) {
       return 1.0;
     }
 
-    auto pair = std::make_pair(u_label, v_label);
-    auto it = synonym.find(pair);
+    auto it = label_synonym.find(std::make_pair(u_label, v_label));
 
     // if u_label v_label is a pair of synonym, then return score
-    if (it != synonym.end()) {
+    if (it != label_synonym.end()) {
       return it->second;
     }
 
-    auto u_vector = gd_label_vector[u];
-    auto v_vector = g_label_vector[v];
-
-    return CosineSimilarity(u_vector, v_vector);
+    return CosineSimilarity(label_vector.RowData(u_label),
+                            label_vector.RowData(v_label), label_vector.dim());
   };
 
-  auto h_p = [&word_embedding, &synonym, &g_path](
+  auto h_p = [&edge_label_vector_sum, &edge_label_word_count, &path_synonym,
+              &g_path, &gd_edge_labels, &g_edge_labels](
                  const graph_t& gd, vertex_t u, vertex_t u1, graph_t& g,
                  vertex_t v, vertex_t v1) -> coord_t {
-    std::string path_u_u1 = ConcatEdgeLabel(gd, u, u1, " ");
-    std::string path_v_v1;
+    edge_label_path_t path_u_u1 = ConcatEdgeLabel(gd, u, u1, gd_edge_labels);
+    edge_label_path_t path_v_v1;
     auto desc_it = g_path.find(v);
 
     // Firstly, finding path with v,v1 endpoints in path file
@@ -446,7 +1362,7 @@ void RunApp() {
 
     // Then, if the path can not be found, start a BFS to construct a path
     if (path_v_v1.empty()) {
-      path_v_v1 = ConcatEdgeLabel(g, v, v1, " ");
+      path_v_v1 = ConcatEdgeLabel(g, v, v1, g_edge_labels);
     }
 
     // Concat label between u...v
@@ -455,15 +1371,19 @@ void RunApp() {
         return 1.0;
       }
 
-      auto it = synonym.find(std::make_pair(path_u_u1, path_v_v1));
+      if (!path_synonym.empty()) {
+        auto it = path_synonym.find(std::make_pair(path_u_u1, path_v_v1));
 
-      // if u_label v_label is a pair of synonym, then return score
-      if (it != synonym.end()) {
-        return it->second;
+        // if u_label v_label is a pair of synonym, then return score
+        if (it != path_synonym.end()) {
+          return it->second;
+        }
       }
 
-      auto e1_vector = TextToVector(word_embedding, path_u_u1);
-      auto e2_vector = TextToVector(word_embedding, path_v_v1);
+      auto e1_vector = PathToVector(edge_label_vector_sum,
+                                    edge_label_word_count, path_u_u1);
+      auto e2_vector = PathToVector(edge_label_vector_sum,
+                                    edge_label_word_count, path_v_v1);
 
       return CosineSimilarity(e1_vector, e2_vector);
     }
@@ -473,8 +1393,9 @@ void RunApp() {
 
   int bfs_depth = FLAGS_bfs_depth;
 
-  auto h_r = [bfs_depth, &g_descendants](const graph_t& g_or_gd,
-                                         vertex_t u_or_v, size_t k, bool is_g) {
+  auto h_r = [bfs_depth, &g_descendants, &gd_edge_labels, &g_edge_labels](
+                 const graph_t& g_or_gd, vertex_t u_or_v, size_t k,
+                 bool is_g) {
     std::vector<std::pair<vertex_t, depth_t>> top_k_descendants;
 
     if (is_g && !g_descendants.empty()) {
@@ -483,7 +1404,8 @@ void RunApp() {
       k = std::min(k, desc.size());
       top_k_descendants.assign(desc.begin(), desc.begin() + k);
     } else {
-      top_k_descendants = BFS(g_or_gd, u_or_v, bfs_depth, k);
+      top_k_descendants = BFS(g_or_gd, u_or_v, bfs_depth, k,
+                              is_g ? g_edge_labels : gd_edge_labels);
     }
     return top_k_descendants;
   };
@@ -554,7 +1476,7 @@ void RunApp() {
 
       CHECK(g.GetId(v, v_oid));
       // Output matched
-      LOG(INFO) << v_oid << "|" << g[v] << std::endl;
+      LOG(INFO) << v_oid << "|" << g.GetLabel(v) << std::endl;
     }
   } else if (query_type == "vpair_benchmark") {
     double sigma = FLAGS_sigma;
@@ -583,9 +1505,8 @@ void RunApp() {
     auto begin = GetCurrentTime();
 
     for (size_t i = 0; i < n_iter; i++) {
-      ans = APairQuery(gd, g, h_v, h_p, h_r, gd_label_vector, g_label_vector,
-                       gd_source_labels, g_source_labels, inverted_index,
-                       parallelism);
+      ans = APairQuery(gd, g, h_v, h_p, h_r, label_vector, gd_source_vertices,
+                       g_source_vertices, inverted_index, parallelism);
     }
     comm.barrier();
 
@@ -602,7 +1523,8 @@ void RunApp() {
         CHECK(gd.GetId(u, u_oid));
         CHECK(g.GetId(v, v_oid));
 
-        fo << u_oid << "|" << v_oid << "|" << gd[u] << "|" << g[v] << std::endl;
+        fo << u_oid << "|" << v_oid << "|" << gd.GetLabel(u) << "|"
+           << g.GetLabel(v) << std::endl;
       }
 
       fo.close();
@@ -613,5 +1535,23 @@ void RunApp() {
 
   timer_end();
 }
+
+/**
+ * Run the application with the vertex ids of the input files parsed as the
+ * type given by -oid_type.
+ */
+void RunApp() {
+  std::string oid_type = FLAGS_oid_type;
+
+  if (oid_type == "int32") {
+    RunApp<int32_t>();
+  } else if (oid_type == "int64") {
+    RunApp<int64_t>();
+  } else if (oid_type == "string") {
+    RunApp<std::string>();
+  } else {
+    LOG(FATAL) << "Invalid param: -oid_type = " << oid_type;
+  }
+}
 }  // namespace her
 #endif  // HER_HER_H_
@@ -0,0 +1,283 @@
+#ifndef HER_INPUT_FILE_H_
+#define HER_INPUT_FILE_H_
+#include <zlib.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+#include "her/mapped_file.h"
+
+namespace her {
+// The amount of text inflated into one block of a gzip file
+static constexpr size_t kInflateBlockSize = 16 << 20;
+
+/**
+ * A newline-aligned piece of an input file, the i-th block of a file has
+ * index i. The content is valid as long as the block is alive.
+ */
+struct InputBlock {
+  size_t index{};
+  const char* begin{};
+  const char* end{};
+  // The line number of begin, only known for blocks of gzip files
+  size_t first_line{};
+  std::shared_ptr<const void> owner;
+};
+
+/**
+ * A text file read as a sequence of newline-aligned blocks, handed out in
+ * file order by NextBlock, which is safe to be called concurrently.
+ *
+ * Plain files are mapped and split into n_blocks blocks. Files starting with
+ * the gzip magic bytes are inflated by a background thread into blocks of
+ * about kInflateBlockSize bytes, so the blocks already inflated are parsed
+ * while the rest of the file is inflated. At most max_pending inflated
+ * blocks wait to be taken, which bounds the memory held by the blocks.
+ */
+class InputFile {
+ public:
+  explicit InputFile(const std::string& path, size_t n_blocks = 1,
+                     size_t max_pending = 2)
+      : path_(path),
+        file_(std::make_shared<MappedFile>(path)),
+        max_pending_(std::max<size_t>(max_pending, 1)) {
+    auto* magic = reinterpret_cast<const unsigned char*>(file_->begin());
+
+    compressed_ = file_->size() >= 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+    if (compressed_) {
+      inflate_thread_ = std::thread([this]() { Inflate(); });
+    } else {
+      chunks_ = ToLineChunks(file_->begin(), file_->end(),
+                             std::max<size_t>(n_blocks, 1));
+    }
+  }
+
+  InputFile(const InputFile&) = delete;
+
+  InputFile& operator=(const InputFile&) = delete;
+
+  ~InputFile() {
+    if (inflate_thread_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        closed_ = true;
+      }
+      cv_.notify_all();
+      inflate_thread_.join();
+    }
+  }
+
+  /**
+   * Take the next block, false is returned at the end of the file. Blocks of
+   * a gzip file are waited for until they are inflated.
+   */
+  bool NextBlock(InputBlock& block) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if (!compressed_) {
+      if (next_chunk_ == chunks_.size()) {
+        return false;
+      }
+      block.index = next_chunk_;
+      block.begin = chunks_[next_chunk_].first;
+      block.end = chunks_[next_chunk_].second;
+      block.first_line = 0;
+      block.owner = file_;
+      next_chunk_++;
+      return true;
+    }
+
+    cv_.wait(lock, [this]() { return !blocks_.empty() || inflated_; });
+    if (blocks_.empty()) {
+      return false;
+    }
+    block = std::move(blocks_.front());
+    blocks_.pop_front();
+    cv_.notify_all();
+    return true;
+  }
+
+  // The line number of pos in block, for error messages
+  size_t LineNo(const InputBlock& block, const char* pos) const {
+    if (!compressed_) {
+      return std::count(file_->begin(), pos, '\n') + 1;
+    }
+    return block.first_line + std::count(block.begin, pos, '\n');
+  }
+
+  bool compressed() const { return compressed_; }
+
+  /**
+   * The mapping of a plain file, blocks point into it. nullptr is returned
+   * for a gzip file, whose blocks are inflated copies.
+   */
+  std::shared_ptr<const MappedFile> mapped_file() const {
+    return compressed_ ? nullptr : file_;
+  }
+
+  const std::string& path() const { return path_; }
+
+ private:
+  // Called by the background thread, blocks are pushed as they are inflated
+  void Inflate() {
+    // zlib takes the input in pieces whose size fits into uInt
+    const size_t max_avail = std::numeric_limits<uInt>::max();
+    auto* in = reinterpret_cast<const Bytef*>(file_->begin());
+    size_t in_left = file_->size();
+    z_stream zs;
+    std::string carry;
+    size_t index = 0, line_no = 1;
+    bool stream_end = false, done = false;
+
+    memset(&zs, 0, sizeof(zs));
+    // 32 lets zlib detect the gzip header
+    CHECK_EQ(inflateInit2(&zs, 15 + 32), Z_OK);
+
+    while (!done) {
+      size_t capacity = std::max(kInflateBlockSize, 2 * carry.size());
+      std::shared_ptr<char> buf(new char[capacity],
+                                std::default_delete<char[]>());
+      size_t size = carry.size();
+
+      // The partial last line of the previous block comes first
+      memcpy(buf.get(), carry.data(), size);
+      while (size < capacity) {
+        if (zs.avail_in == 0) {
+          if (in_left == 0) {
+            done = true;
+            break;
+          }
+          zs.next_in = const_cast<Bytef*>(in);
+          zs.avail_in = std::min(in_left, max_avail);
+          in += zs.avail_in;
+          in_left -= zs.avail_in;
+        }
+        zs.next_out = reinterpret_cast<Bytef*>(buf.get() + size);
+        zs.avail_out = std::min(capacity - size, max_avail);
+
+        int ret = inflate(&zs, Z_NO_FLUSH);
+
+        size = reinterpret_cast<char*>(zs.next_out) - buf.get();
+        if (ret == Z_STREAM_END) {
+          stream_end = true;
+          // A gzip file may consist of several members, e.g. from pigz
+          if (zs.avail_in > 0 || in_left > 0) {
+            CHECK_EQ(inflateReset(&zs), Z_OK);
+            stream_end = false;
+          }
+        } else {
+          CHECK(ret == Z_OK || ret == Z_BUF_ERROR)
+              << "Failed to inflate " << path_ << ": "
+              << (zs.msg == nullptr ? "corrupted data" : zs.msg);
+        }
+      }
+      CHECK(!done || stream_end) << "Truncated gzip file " << path_;
+
+      const char* begin = buf.get();
+      const char* end = begin + size;
+
+      if (!done) {
+        auto* nl = static_cast<const char*>(memrchr(begin, '\n', size));
+
+        // A line longer than the block is continued by a larger block
+        end = nl == nullptr ? begin : nl + 1;
+      }
+      carry.assign(end, begin + size);
+
+      if (end > begin) {
+        InputBlock block;
+
+        block.index = index++;
+        block.begin = begin;
+        block.end = end;
+        block.first_line = line_no;
+        block.owner = buf;
+        line_no += std::count(begin, end, '\n');
+        if (!Push(std::move(block))) {
+          break;
+        }
+      }
+    }
+    inflateEnd(&zs);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      inflated_ = true;
+    }
+    cv_.notify_all();
+  }
+
+  // Wait for room for the block, false is returned if the file is closed
+  bool Push(InputBlock&& block) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    cv_.wait(lock,
+             [this]() { return blocks_.size() < max_pending_ || closed_; });
+    if (closed_) {
+      return false;
+    }
+    blocks_.push_back(std::move(block));
+    cv_.notify_all();
+    return true;
+  }
+
+  std::string path_;
+  std::shared_ptr<MappedFile> file_;
+  bool compressed_{};
+  // Blocks of a plain file
+  std::vector<std::pair<const char*, const char*>> chunks_;
+  size_t next_chunk_{};
+  // Blocks of a gzip file, inflated by inflate_thread_
+  size_t max_pending_;
+  std::deque<InputBlock> blocks_;
+  bool inflated_{};
+  bool closed_{};
+  std::thread inflate_thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+/**
+ * Read a text file line by line, like std::getline. Gzip files are inflated
+ * by a background thread.
+ */
+class LineReader {
+ public:
+  explicit LineReader(const std::string& path) : input_(path) {}
+
+  bool GetLine(std::string& line) {
+    while (pos_ == block_.end) {
+      if (!input_.NextBlock(block_)) {
+        return false;
+      }
+      pos_ = block_.begin;
+    }
+
+    auto* nl = static_cast<const char*>(memchr(pos_, '\n', block_.end - pos_));
+    const char* line_end = nl == nullptr ? block_.end : nl;
+
+    line.assign(pos_, line_end);
+    pos_ = nl == nullptr ? block_.end : nl + 1;
+    return true;
+  }
+
+ private:
+  InputFile input_;
+  InputBlock block_;
+  const char* pos_{};
+};
+
+}  // namespace her
+#endif  // HER_INPUT_FILE_H_
@@ -1,11 +1,23 @@
 #ifndef PARAMATRICSIMULATION_HER_INVERTED_INDEX_H_
 #define PARAMATRICSIMULATION_HER_INVERTED_INDEX_H_
+#include <algorithm>
+#include <string>
+#include <iterator>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
-#include "boost/algorithm/string.hpp"
+#include "her/label_dictionary.h"
+#include "her/memory_policy.h"
+#include "her/snapshot.h"
+#include "her/source_vertices.h"
+#include "her/tokenizer.h"
 
+/**
+ * The vertices of G with a source label, indexed by the words of their label.
+ * Words are ids of the word dictionary shared by GD and G, postings are
+ * sorted vertex lists.
+ */
 template <typename GRAPH_T>
 class InvertedIndex {
   using vertex_t = typename GRAPH_T::vertex_t;
@@ -14,50 +26,113 @@ class InvertedIndex {
 
  public:
   void Init(const GRAPH_T& g,
-            const std::unordered_set<std::string>& g_source_labels) {
-    for (auto& v : g.Vertices()) {
-      auto& label = g[v];
+            const her::SourceVertices<GRAPH_T>& g_source_vertices) {
+    auto& word_dict = g.word_dict();
+    auto is_blank = BlankWords(word_dict);
 
-      if (g.OutDegree(v) > 0 &&
-          g_source_labels.find(label) != g_source_labels.end()) {
-        std::vector<std::string> words;
+    patched_.clear();
 
-        boost::split(words, label, boost::is_any_of("\t "),
-                     boost::token_compress_on);
+    // The postings are built as a CSR: count, prefix sum and fill
+    her::large_vector_t<uint64_t> offsets(word_dict.size() + 1, 0);
+    her::large_vector_t<vertex_t> postings;
 
-        for (auto& word : words) {
-          if (blank_word.find(word) == blank_word.end()) {
-            word_indices_[word].insert(v);
-          }
+    ForEachPosting(g, g_source_vertices, is_blank,
+                   [&offsets](her::label_id_t word, vertex_t v) {
+                     offsets[word + 1]++;
+                   });
+    for (size_t i = 0; i < word_dict.size(); i++) {
+      offsets[i + 1] += offsets[i];
+    }
+    postings.resize(offsets.back());
+    {
+      std::vector<uint64_t> pos(offsets.begin(), offsets.end() - 1);
+
+      ForEachPosting(g, g_source_vertices, is_blank,
+                     [&pos, &postings](her::label_id_t word, vertex_t v) {
+                       postings[pos[word]++] = v;
+                     });
+    }
+    offsets_ = her::SharedArray<uint64_t>(std::move(offsets));
+    postings_ = her::SharedArray<vertex_t>(std::move(postings));
+  }
+
+  /**
+   * Update the postings of the vertices touched by a delta applied to g,
+   * flags must cover the labels added by the delta. Only the postings of
+   * words that a touched vertex gains or loses are changed.
+   */
+  void Update(const GRAPH_T& g, const std::vector<bool>& g_source_label_flags,
+              const typename GRAPH_T::update_t& update) {
+    auto is_blank = BlankWords(g.word_dict());
+    std::vector<her::label_id_t> old_words, new_words, diff;
+
+    for (size_t i = 0; i < update.vertices.size(); i++) {
+      auto v = update.vertices[i];
+      auto old_label = update.old_labels[i];
+
+      old_words.clear();
+      new_words.clear();
+      if (update.had_out_edges[i] && g_source_label_flags[old_label]) {
+        IndexedWords(g.label_tokens().Get(old_label), is_blank, old_words);
+      }
+      if (g.OutDegree(v) > 0 && g_source_label_flags[g[v]]) {
+        IndexedWords(g.GetTokens(v), is_blank, new_words);
+      }
+
+      diff.clear();
+      std::set_difference(old_words.begin(), old_words.end(),
+                          new_words.begin(), new_words.end(),
+                          std::back_inserter(diff));
+      for (auto word : diff) {
+        auto& posting = MutablePosting(word);
+        auto it = std::lower_bound(posting.begin(), posting.end(), v);
+
+        if (it != posting.end() && *it == v) {
+          posting.erase(it);
+        }
+      }
+
+      diff.clear();
+      std::set_difference(new_words.begin(), new_words.end(),
+                          old_words.begin(), old_words.end(),
+                          std::back_inserter(diff));
+      for (auto word : diff) {
+        auto& posting = MutablePosting(word);
+        auto it = std::lower_bound(posting.begin(), posting.end(), v);
+
+        if (it == posting.end() || *it != v) {
+          posting.insert(it, v);
         }
       }
     }
   }
 
-  std::set<vertex_t> Query(const std::string& label) const {
-    std::vector<std::string> words;
-    std::set<vertex_t> result;
-
-    boost::split(words, label, boost::is_any_of("\t "),
-                 boost::token_compress_on);
+  /**
+   * The vertices having all the indexed words of tokens, words that are not
+   * indexed are ignored.
+   */
+  std::vector<vertex_t> Query(her::TokenTable::token_list_t tokens) const {
+    std::vector<vertex_t> result, tmp;
+    bool first = true;
 
-    for (auto& word : words) {
-      auto it = word_indices_.find(word);
+    for (auto word : tokens) {
+      const vertex_t *begin, *end;
 
-      if (it != word_indices_.end()) {
-        auto& curr_set = it->second;
+      Posting(word, begin, end);
+      if (begin == end) {
+        continue;
+      }
 
+      if (first) {
+        result.assign(begin, end);
+        first = false;
+      } else {
+        tmp.clear();
+        std::set_intersection(result.begin(), result.end(), begin, end,
+                              std::back_inserter(tmp));
+        result.swap(tmp);
         if (result.empty()) {
-          result = curr_set;
-        } else {
-          std::set<vertex_t> tmp;
-          std::set_intersection(result.begin(), result.end(), curr_set.begin(),
-                                curr_set.end(),
-                                std::inserter(tmp, tmp.begin()));
-          result = tmp;
-          if (result.empty()) {
-            return {};
-          }
+          return {};
         }
       }
     }
@@ -65,7 +140,125 @@ class InvertedIndex {
     return result;
   }
 
+  void Serialize(her::SnapshotWriter& writer) const {
+    if (patched_.empty()) {
+      writer.WriteVector(offsets_);
+      writer.WriteVector(postings_);
+      return;
+    }
+
+    // Patched postings are merged into the CSR
+    size_t n_words = offsets_.empty() ? 0 : offsets_.size() - 1;
+    std::vector<uint64_t> offsets(1, 0);
+    std::vector<vertex_t> postings;
+
+    for (auto& pair : patched_) {
+      n_words = std::max<size_t>(n_words, pair.first + 1);
+    }
+    for (size_t word = 0; word < n_words; word++) {
+      const vertex_t *begin, *end;
+
+      Posting(word, begin, end);
+      postings.insert(postings.end(), begin, end);
+      offsets.push_back(postings.size());
+    }
+    writer.WriteVector(offsets);
+    writer.WriteVector(postings);
+  }
+
+  // The postings are used in place
+  void Deserialize(her::SnapshotReader& reader) {
+    reader.ReadVector(offsets_);
+    reader.ReadVector(postings_);
+    patched_.clear();
+    CHECK(!offsets_.empty() &&
+          offsets_[offsets_.size() - 1] == postings_.size())
+        << "Corrupted snapshot";
+  }
+
  private:
-  std::unordered_map<std::string, std::set<vertex_t>> word_indices_;
+  std::vector<bool> BlankWords(const her::LabelDictionary& word_dict) const {
+    std::vector<bool> is_blank(word_dict.size(), false);
+
+    for (auto& word : blank_word) {
+      her::label_id_t id;
+
+      if (word_dict.Find(word, id)) {
+        is_blank[id] = true;
+      }
+    }
+    return is_blank;
+  }
+
+  // The sorted distinct words of tokens that are not blank words
+  static void IndexedWords(her::TokenTable::token_list_t tokens,
+                           const std::vector<bool>& is_blank,
+                           std::vector<her::label_id_t>& words) {
+    words.clear();
+    for (auto word : tokens) {
+      if (!is_blank[word]) {
+        words.push_back(word);
+      }
+    }
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+  }
+
+  /**
+   * Call func(word, v) for every indexed word of every source vertex v, in
+   * ascending order of v. A word occurring twice in a label is taken once.
+   */
+  template <typename FUNC_T>
+  static void ForEachPosting(
+      const GRAPH_T& g, const her::SourceVertices<GRAPH_T>& g_source_vertices,
+      const std::vector<bool>& is_blank, const FUNC_T& func) {
+    std::vector<her::label_id_t> words;
+
+    for (auto v : g_source_vertices.vertices()) {
+      IndexedWords(g.GetTokens(v), is_blank, words);
+      for (auto word : words) {
+        func(word, v);
+      }
+    }
+  }
+
+  void Posting(her::label_id_t word, const vertex_t*& begin,
+               const vertex_t*& end) const {
+    if (!patched_.empty()) {
+      auto it = patched_.find(word);
+
+      if (it != patched_.end()) {
+        begin = it->second.data();
+        end = begin + it->second.size();
+        return;
+      }
+    }
+    if (word + 1 >= offsets_.size()) {
+      begin = end = nullptr;
+      return;
+    }
+    begin = postings_.data() + offsets_[word];
+    end = postings_.data() + offsets_[word + 1];
+  }
+
+  // The postings of word, copied out of the CSR on the first change
+  std::vector<vertex_t>& MutablePosting(her::label_id_t word) {
+    auto it = patched_.find(word);
+
+    if (it == patched_.end()) {
+      const vertex_t *begin, *end;
+
+      Posting(word, begin, end);
+      it = patched_.emplace(word, std::vector<vertex_t>(begin, end)).first;
+    }
+    return it->second;
+  }
+
+  // The postings of word w are postings_[offsets_[w], offsets_[w + 1]), in
+  // ascending order of vertices
+  her::SharedArray<uint64_t> offsets_;
+  her::SharedArray<vertex_t> postings_;
+  // Postings changed by deltas, they replace those of the CSR
+  std::unordered_map<her::label_id_t, std::vector<vertex_t>> patched_;
 };
 #endif  // PARAMATRICSIMULATION_HER_INVERTED_INDEX_H_
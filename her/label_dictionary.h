@@ -0,0 +1,284 @@
+#ifndef HER_LABEL_DICTIONARY_H_
+#define HER_LABEL_DICTIONARY_H_
+#include <boost/utility/string_view.hpp>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+#include "her/snapshot.h"
+
+namespace her {
+using label_id_t = uint32_t;
+
+static constexpr label_id_t kInvalidLabel =
+    std::numeric_limits<label_id_t>::max();
+
+/**
+ * A dictionary of deduplicated labels. Every distinct label is stored once and
+ * identified by a dense 32-bit id, so the vertex data of a graph is an id and
+ * label equality is an integer comparison. Lookup by content goes through an
+ * open-addressing table of ids.
+ *
+ * Labels are kept as views. Interned labels are copied into blocks owned by
+ * the dictionary, unless they are interned by InternView from memory that
+ * lives as long as the dictionary, such as a mapped input file or snapshot.
+ * Blocks never move, and copies of a dictionary share them. A dictionary read
+ * from a snapshot uses its labels, hashes and slots in place, the tables are
+ * copied only once a new label is interned.
+ */
+class LabelDictionary {
+ public:
+  LabelDictionary()
+      : slots_(std::vector<label_id_t>(kInitialSlots, kInvalidLabel)) {}
+
+  // Labels interned into a copy later are stored apart from the original
+  LabelDictionary(const LabelDictionary& other)
+      : arena_(other.arena_),
+        offsets_(other.offsets_),
+        n_mapped_(other.n_mapped_),
+        labels_(other.labels_),
+        hashes_(other.hashes_),
+        slots_(other.slots_),
+        owners_(other.owners_) {}
+
+  LabelDictionary(LabelDictionary&& other) : LabelDictionary() {
+    Swap(other);
+  }
+
+  LabelDictionary& operator=(LabelDictionary other) {
+    Swap(other);
+    return *this;
+  }
+
+  /**
+   * Return the id of the label, a new id is assigned if the label is unseen.
+   * A new label is copied.
+   */
+  label_id_t Intern(boost::string_view label) {
+    return Intern(label, true);
+  }
+
+  /**
+   * Like Intern, but a new label is not copied. The bytes of label have to
+   * stay valid as long as the dictionary, which can keep them alive by
+   * Retain.
+   */
+  label_id_t InternView(boost::string_view label) {
+    return Intern(label, false);
+  }
+
+  // Keep owner alive as long as the dictionary and its copies
+  void Retain(std::shared_ptr<const void> owner) {
+    if (owner != nullptr &&
+        std::find(owners_.begin(), owners_.end(), owner) == owners_.end()) {
+      owners_.push_back(std::move(owner));
+    }
+  }
+
+  /**
+   * Keep the storage of the labels of other alive, so that they can be
+   * interned by InternView.
+   */
+  void Retain(const LabelDictionary& other) {
+    for (auto& owner : other.owners_) {
+      Retain(owner);
+    }
+  }
+
+  bool Find(boost::string_view label, label_id_t& id) const {
+    id = slots_[FindSlot(label, Hash(label))];
+    return id != kInvalidLabel;
+  }
+
+  boost::string_view Get(label_id_t id) const {
+    if (id < n_mapped_) {
+      return boost::string_view(arena_.data() + offsets_[id],
+                                offsets_[id + 1] - offsets_[id]);
+    }
+    return labels_[id - n_mapped_];
+  }
+
+  label_id_t size() const { return n_mapped_ + labels_.size(); }
+
+  size_t ArenaBytes() const {
+    size_t bytes = arena_.size();
+
+    for (auto& label : labels_) {
+      bytes += label.size();
+    }
+    return bytes;
+  }
+
+  /**
+   * The labels are written back to back, the layout does not depend on where
+   * the labels are stored.
+   */
+  void Serialize(SnapshotWriter& writer) const {
+    std::vector<std::pair<const char*, size_t>> pieces;
+    std::vector<uint64_t> offsets(1, 0);
+
+    pieces.reserve(size());
+    offsets.reserve(size() + 1);
+    for (label_id_t id = 0; id < size(); id++) {
+      auto label = Get(id);
+
+      pieces.emplace_back(label.data(), label.size());
+      offsets.push_back(offsets.back() + label.size());
+    }
+    writer.WriteArrays(pieces);
+    writer.WriteVector(offsets);
+    writer.WriteVector(hashes_);
+    writer.WriteVector(slots_);
+  }
+
+  /**
+   * The labels and the tables are used in place, they keep the mapping of the
+   * reader alive.
+   */
+  void Deserialize(SnapshotReader& reader) {
+    *this = LabelDictionary();
+    reader.ReadVector(arena_);
+    reader.ReadVector(offsets_);
+    reader.ReadVector(hashes_);
+    reader.ReadVector(slots_);
+    CHECK(!offsets_.empty() && offsets_[offsets_.size() - 1] == arena_.size() &&
+          hashes_.size() + 1 == offsets_.size() &&
+          (slots_.size() & (slots_.size() - 1)) == 0 &&
+          slots_.size() >= 2 * hashes_.size())
+        << "Corrupted snapshot";
+    n_mapped_ = hashes_.size();
+    Retain(reader.file());
+  }
+
+ private:
+  static constexpr size_t kInitialSlots = 1024;
+  static constexpr size_t kMinBlockSize = 4 << 10;
+  static constexpr size_t kMaxBlockSize = 1 << 20;
+
+  label_id_t Intern(boost::string_view label, bool copy) {
+    auto hash = Hash(label);
+    auto slot = FindSlot(label, hash);
+
+    if (slots_[slot] != kInvalidLabel) {
+      return slots_[slot];
+    }
+
+    label_id_t id = size();
+
+    CHECK_LT(id, kInvalidLabel) << "Too many labels";
+    labels_.push_back(copy ? Store(label) : label);
+    hashes_.Mutable().push_back(hash);
+    slots_.Mutable()[slot] = id;
+
+    if (2 * hashes_.size() > slots_.size()) {
+      Rehash(2 * slots_.size());
+    }
+    return id;
+  }
+
+  // Copy label into the last block, a larger block is added if it is full
+  boost::string_view Store(boost::string_view label) {
+    if (label.size() > tail_left_) {
+      // Blocks grow from kMinBlockSize to kMaxBlockSize bytes
+      size_t block_size = block_size_ == 0 ? kMinBlockSize : 2 * block_size_;
+
+      if (block_size > kMaxBlockSize) {
+        block_size = kMaxBlockSize;
+      }
+      block_size = std::max(block_size, label.size());
+
+      std::shared_ptr<char> block(new char[block_size],
+                                  std::default_delete<char[]>());
+
+      tail_ = block.get();
+      tail_left_ = block_size;
+      block_size_ = block_size;
+      owners_.push_back(std::move(block));
+    }
+
+    char* data = tail_;
+
+    std::copy(label.begin(), label.end(), data);
+    tail_ += label.size();
+    tail_left_ -= label.size();
+    return boost::string_view(data, label.size());
+  }
+
+  void Swap(LabelDictionary& other) {
+    std::swap(arena_, other.arena_);
+    std::swap(offsets_, other.offsets_);
+    std::swap(n_mapped_, other.n_mapped_);
+    labels_.swap(other.labels_);
+    hashes_.swap(other.hashes_);
+    slots_.swap(other.slots_);
+    owners_.swap(other.owners_);
+    std::swap(tail_, other.tail_);
+    std::swap(tail_left_, other.tail_left_);
+    std::swap(block_size_, other.block_size_);
+  }
+
+  // FNV-1a
+  static uint32_t Hash(boost::string_view label) {
+    uint64_t hash = 14695981039346656037ull;
+
+    for (char c : label) {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 1099511628211ull;
+    }
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+  }
+
+  // The slot holding the label, or the empty slot where it should be put
+  size_t FindSlot(boost::string_view label, uint32_t hash) const {
+    size_t mask = slots_.size() - 1;
+    size_t slot = hash & mask;
+
+    while (slots_[slot] != kInvalidLabel) {
+      auto id = slots_[slot];
+
+      if (hashes_[id] == hash && Get(id) == label) {
+        break;
+      }
+      slot = (slot + 1) & mask;
+    }
+    return slot;
+  }
+
+  void Rehash(size_t n_slots) {
+    size_t mask = n_slots - 1;
+    std::vector<label_id_t> slots(n_slots, kInvalidLabel);
+
+    for (label_id_t id = 0; id < hashes_.size(); id++) {
+      size_t slot = hashes_[id] & mask;
+
+      while (slots[slot] != kInvalidLabel) {
+        slot = (slot + 1) & mask;
+      }
+      slots[slot] = id;
+    }
+    slots_ = std::move(slots);
+  }
+
+  // The labels read from a snapshot are the first n_mapped_ ids, the label
+  // of id i is arena_[offsets_[i], offsets_[i + 1])
+  SharedArray<char> arena_;
+  SharedArray<uint64_t> offsets_;
+  label_id_t n_mapped_{};
+  // The labels interned after, with ids from n_mapped_ on
+  std::vector<boost::string_view> labels_;
+  CowArray<uint32_t> hashes_;
+  CowArray<label_id_t> slots_;
+  // The blocks of copied labels and the memory of labels interned as views
+  std::vector<std::shared_ptr<const void>> owners_;
+  // The free room of the last block, only this dictionary writes into it
+  char* tail_{};
+  size_t tail_left_{};
+  size_t block_size_{};
+};
+
+}  // namespace her
+#endif  // HER_LABEL_DICTIONARY_H_
@@ -0,0 +1,119 @@
+#ifndef HER_MAPPED_FILE_H_
+#define HER_MAPPED_FILE_H_
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+
+namespace her {
+
+/**
+ * A read-only memory mapping of a whole file. The mapping lives as long as
+ * the object, the content is exposed as a [begin, end) range of chars.
+ */
+class MappedFile {
+ public:
+  MappedFile() = default;
+
+  explicit MappedFile(const std::string& path, int advice = MADV_SEQUENTIAL) {
+    Open(path, advice);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() { Close(); }
+
+  /**
+   * Map the file, advice is passed to madvise. The default suits a single
+   * pass over the content, use MADV_NORMAL for data accessed randomly.
+   */
+  void Open(const std::string& path, int advice = MADV_SEQUENTIAL) {
+    Close();
+    int fd = open(path.c_str(), O_RDONLY);
+
+    CHECK_NE(fd, -1) << "Failed to open " << path << ": " << strerror(errno);
+
+    struct stat st;
+
+    CHECK_EQ(fstat(fd, &st), 0)
+        << "Failed to stat " << path << ": " << strerror(errno);
+    size_ = st.st_size;
+
+    if (size_ > 0) {
+      void* addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+
+      CHECK(addr != MAP_FAILED)
+          << "Failed to mmap " << path << ": " << strerror(errno);
+      madvise(addr, size_, advice);
+      data_ = static_cast<const char*>(addr);
+    }
+    close(fd);
+  }
+
+  void Close() {
+    if (data_ != nullptr) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+  }
+
+  // Change the advice given to madvise, e.g. once sequential reading is done
+  void Advise(int advice) const {
+    if (data_ != nullptr) {
+      madvise(const_cast<char*>(data_), size_, advice);
+    }
+  }
+
+  const char* begin() const { return data_; }
+
+  const char* end() const { return data_ + size_; }
+
+  size_t size() const { return size_; }
+
+ private:
+  const char* data_{};
+  size_t size_{};
+};
+
+/**
+ * Split [begin, end) into at most n_chunks pieces of similar size, every
+ * piece except the last one ends right after a '\n'.
+ */
+inline std::vector<std::pair<const char*, const char*>> ToLineChunks(
+    const char* begin, const char* end, size_t n_chunks) {
+  std::vector<std::pair<const char*, const char*>> chunks;
+  size_t size = end - begin;
+  size_t chunk_size = (size + n_chunks - 1) / std::max<size_t>(n_chunks, 1);
+  const char* chunk_begin = begin;
+
+  while (chunk_begin < end) {
+    const char* chunk_end =
+        chunk_begin + std::min<size_t>(chunk_size, end - chunk_begin);
+
+    if (chunk_end < end) {
+      auto* nl = static_cast<const char*>(
+          memchr(chunk_end, '\n', end - chunk_end));
+
+      chunk_end = nl == nullptr ? end : nl + 1;
+    }
+    chunks.emplace_back(chunk_begin, chunk_end);
+    chunk_begin = chunk_end;
+  }
+
+  return chunks;
+}
+
+}  // namespace her
+#endif  // HER_MAPPED_FILE_H_
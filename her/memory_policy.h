@@ -0,0 +1,444 @@
+#ifndef HER_MEMORY_POLICY_H_
+#define HER_MEMORY_POLICY_H_
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+
+namespace her {
+// Arrays of at least this size are large arrays, they are mapped by
+// LargeArrayRegistry and follow the large array policy
+static constexpr size_t kLargeArrayBytes = 2 << 20;
+static constexpr size_t kHugePageBytes = 2 << 20;
+
+/**
+ * How the pages of large arrays are backed, see -huge_pages.
+ */
+enum class HugePagePolicy {
+  // Base pages, the kernel may still collapse them into transparent huge
+  // pages depending on /sys/kernel/mm/transparent_hugepage/enabled
+  kNone,
+  // Arrays are aligned to 2 MB and advised with MADV_HUGEPAGE
+  kTransparent,
+  // Arrays are mapped from the reserved huge pages (MAP_HUGETLB), arrays
+  // which do not fit into the free reserved pages fall back to kTransparent
+  kExplicit
+};
+
+/**
+ * Where the pages of large arrays are placed on a NUMA machine, see
+ * -numa_policy.
+ */
+enum class NumaPolicy {
+  // On the node of the thread touching a page first
+  kLocal,
+  // Round robin over all nodes, so threads of all nodes see the same mix of
+  // local and remote accesses
+  kInterleave
+};
+
+inline bool ParseHugePagePolicy(const std::string& name,
+                                HugePagePolicy& policy) {
+  if (name == "none") {
+    policy = HugePagePolicy::kNone;
+  } else if (name == "transparent") {
+    policy = HugePagePolicy::kTransparent;
+  } else if (name == "explicit") {
+    policy = HugePagePolicy::kExplicit;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+inline bool ParseNumaPolicy(const std::string& name, NumaPolicy& policy) {
+  if (name == "local") {
+    policy = NumaPolicy::kLocal;
+  } else if (name == "interleave") {
+    policy = NumaPolicy::kInterleave;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Counters of the large arrays allocated so far, to verify that a policy
+ * took effect. The byte counters cover the live arrays.
+ */
+struct LargeArrayStats {
+  size_t n_arrays{};
+  size_t bytes{};
+  // Mapped from reserved huge pages
+  size_t explicit_huge_bytes{};
+  // Advised with MADV_HUGEPAGE, whether the kernel backs them by huge pages
+  // shows in AnonHugePages
+  size_t transparent_huge_bytes{};
+  size_t interleaved_bytes{};
+  // Arrays of kExplicit which did not fit into the reserved huge pages
+  size_t n_explicit_fallbacks{};
+  // Arrays of kInterleave the kernel refused to interleave, e.g. because
+  // the process may not set memory policies
+  size_t n_interleave_failures{};
+};
+
+/**
+ * The large arrays of the process and the policy new arrays are allocated
+ * by. It is process wide, as memory placement is.
+ */
+class LargeArrayRegistry {
+  struct Region {
+    size_t length;
+    size_t bytes;
+    bool explicit_huge;
+    bool transparent_huge;
+    bool interleaved;
+  };
+
+ public:
+  static LargeArrayRegistry& Get() {
+    static LargeArrayRegistry registry;
+
+    return registry;
+  }
+
+  void SetPolicy(HugePagePolicy huge_pages, NumaPolicy numa) {
+    huge_pages_ = huge_pages;
+    numa_ = numa;
+  }
+
+  // Map bytes of zeros
+  void* Allocate(size_t bytes) {
+    Region region{};
+    void* addr = nullptr;
+
+    region.bytes = bytes;
+    if (huge_pages_ == HugePagePolicy::kExplicit) {
+      region.length = RoundUp(bytes, kHugePageBytes);
+      addr = mmap(nullptr, region.length, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (addr == MAP_FAILED) {
+        addr = nullptr;
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.n_explicit_fallbacks++;
+      } else {
+        region.explicit_huge = true;
+      }
+    }
+    if (addr == nullptr) {
+      bool huge = huge_pages_ != HugePagePolicy::kNone;
+
+      region.length = RoundUp(bytes, huge ? kHugePageBytes : PageBytes());
+      addr = Map(region.length, huge ? kHugePageBytes : PageBytes());
+      if (huge) {
+        region.transparent_huge = madvise(addr, region.length,
+                                          MADV_HUGEPAGE) == 0;
+      }
+    }
+    // The policy must be set before the pages are touched
+    if (numa_ == NumaPolicy::kInterleave) {
+      region.interleaved = Interleave(addr, region.length);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (numa_ == NumaPolicy::kInterleave && !region.interleaved) {
+      stats_.n_interleave_failures++;
+    }
+    regions_[addr] = region;
+    Count(region, 1);
+    return addr;
+  }
+
+  void Free(void* addr) {
+    Region region;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = regions_.find(addr);
+
+      CHECK(it != regions_.end()) << "Not a large array: " << addr;
+      region = it->second;
+      Count(region, -1);
+      regions_.erase(it);
+    }
+    munmap(addr, region.length);
+  }
+
+  LargeArrayStats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return stats_;
+  }
+
+  /**
+   * The number of sampled pages of the large arrays resident on each node,
+   * the last element counts the sampled pages not resident yet. At most
+   * max_samples pages are sampled, evenly over the arrays.
+   */
+  std::vector<size_t> SamplePageNodes(size_t max_samples) const {
+    std::vector<void*> pages;
+    size_t total = 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto& pair : regions_) {
+      total += pair.second.length;
+    }
+
+    size_t stride = std::max(RoundUp(total / std::max<size_t>(max_samples, 1),
+                                     PageBytes()),
+                             PageBytes());
+
+    for (auto& pair : regions_) {
+      auto* begin = static_cast<char*>(pair.first);
+
+      for (size_t off = 0; off < pair.second.length; off += stride) {
+        pages.push_back(begin + off);
+      }
+    }
+
+    std::vector<int> status(pages.size(), -1);
+    std::vector<size_t> n_pages(1, 0);
+
+    // Without target nodes move_pages only reports where the pages are
+    if (!pages.empty() &&
+        syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr,
+                status.data(), 0) != 0) {
+      status.assign(pages.size(), -1);
+    }
+    for (auto node : status) {
+      if (node < 0) {
+        n_pages.back()++;
+        continue;
+      }
+      if (static_cast<size_t>(node) + 1 >= n_pages.size()) {
+        n_pages.insert(n_pages.end() - 1, node + 2 - n_pages.size(), 0);
+      }
+      n_pages[node]++;
+    }
+    return n_pages;
+  }
+
+ private:
+  LargeArrayRegistry() = default;
+
+  static size_t PageBytes() {
+    static const size_t page_bytes = sysconf(_SC_PAGESIZE);
+
+    return page_bytes;
+  }
+
+  static size_t RoundUp(size_t n, size_t unit) {
+    return (n + unit - 1) / unit * unit;
+  }
+
+  // Map length bytes starting at a multiple of alignment
+  static void* Map(size_t length, size_t alignment) {
+    size_t extra = alignment > PageBytes() ? alignment : 0;
+    void* addr = mmap(nullptr, length + extra, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (addr == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    if (extra > 0) {
+      auto begin = reinterpret_cast<uintptr_t>(addr);
+      auto aligned = RoundUp(begin, alignment);
+
+      if (aligned > begin) {
+        munmap(addr, aligned - begin);
+      }
+      if (begin + extra > aligned) {
+        munmap(reinterpret_cast<void*>(aligned + length),
+               begin + extra - aligned);
+      }
+      addr = reinterpret_cast<void*>(aligned);
+    }
+    return addr;
+  }
+
+  // The online nodes as a node mask, from /sys/devices/system/node/online,
+  // e.g. "0-1"
+  static std::vector<unsigned long> OnlineNodes() {  // NOLINT
+    std::ifstream fi("/sys/devices/system/node/online");
+    std::vector<unsigned long> mask(1, 0);  // NOLINT
+    std::string range;
+    size_t bits = std::numeric_limits<unsigned long>::digits;  // NOLINT
+
+    if (!fi.is_open()) {
+      mask[0] = 1;
+      return mask;
+    }
+    while (std::getline(fi, range, ',')) {
+      size_t first = strtoul(range.c_str(), nullptr, 10);
+      auto dash = range.find('-');
+      size_t last = dash == std::string::npos
+                        ? first
+                        : strtoul(range.c_str() + dash + 1, nullptr, 10);
+
+      for (size_t node = first; node <= last; node++) {
+        if (node / bits >= mask.size()) {
+          mask.resize(node / bits + 1, 0);
+        }
+        mask[node / bits] |= 1ul << (node % bits);
+      }
+    }
+    return mask;
+  }
+
+  // mbind is called directly, so HER does not depend on libnuma
+  static bool Interleave(void* addr, size_t length) {
+    static constexpr int kMpolInterleave = 3;
+    static const auto nodes = OnlineNodes();
+    size_t max_node =
+        nodes.size() * std::numeric_limits<unsigned long>::digits;  // NOLINT
+
+    return syscall(SYS_mbind, addr, length, kMpolInterleave, nodes.data(),
+                   max_node + 1, 0) == 0;
+  }
+
+  void Count(const Region& region, int sign) {
+    stats_.n_arrays += sign;
+    stats_.bytes += sign * region.bytes;
+    if (region.explicit_huge) {
+      stats_.explicit_huge_bytes += sign * region.bytes;
+    }
+    if (region.transparent_huge) {
+      stats_.transparent_huge_bytes += sign * region.bytes;
+    }
+    if (region.interleaved) {
+      stats_.interleaved_bytes += sign * region.bytes;
+    }
+  }
+
+  HugePagePolicy huge_pages_{HugePagePolicy::kNone};
+  NumaPolicy numa_{NumaPolicy::kLocal};
+  mutable std::mutex mutex_;
+  std::map<void*, Region> regions_;
+  LargeArrayStats stats_;
+};
+
+/**
+ * Allocate bytes of zeros aligned to alignment, held by owner. Large arrays
+ * follow the large array policy, smaller ones come from the heap.
+ */
+inline void* AllocateZeroed(size_t bytes, size_t alignment,
+                            std::shared_ptr<const void>& owner) {
+  void* addr = nullptr;
+
+  owner.reset();
+  if (bytes == 0) {
+    return nullptr;
+  }
+  if (bytes >= kLargeArrayBytes) {
+    addr = LargeArrayRegistry::Get().Allocate(bytes);
+    owner = std::shared_ptr<const void>(addr, [](const void* p) {
+      LargeArrayRegistry::Get().Free(const_cast<void*>(p));
+    });
+    return addr;
+  }
+  CHECK_EQ(posix_memalign(&addr, alignment, bytes), 0)
+      << "Failed to allocate " << bytes << " bytes";
+  memset(addr, 0, bytes);
+  owner = std::shared_ptr<const void>(addr, std::free);
+  return addr;
+}
+
+/**
+ * An allocator placing large arrays by the large array policy, e.g. for the
+ * CSR of a graph. Whether an array is large only depends on its size, so
+ * deallocate takes the same path as allocate.
+ */
+template <typename T>
+class LargeArrayAllocator {
+ public:
+  using value_type = T;
+
+  LargeArrayAllocator() = default;
+
+  template <typename U>
+  LargeArrayAllocator(const LargeArrayAllocator<U>&) {}  // NOLINT
+
+  T* allocate(size_t n) {
+    if (n * sizeof(T) >= kLargeArrayBytes) {
+      return static_cast<T*>(
+          LargeArrayRegistry::Get().Allocate(n * sizeof(T)));
+    }
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, size_t n) {
+    if (n * sizeof(T) >= kLargeArrayBytes) {
+      LargeArrayRegistry::Get().Free(p);
+    } else {
+      std::allocator<T>().deallocate(p, n);
+    }
+  }
+
+  template <typename U>
+  bool operator==(const LargeArrayAllocator<U>&) const {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const LargeArrayAllocator<U>&) const {
+    return false;
+  }
+};
+
+template <typename T>
+using large_vector_t = std::vector<T, LargeArrayAllocator<T>>;
+
+/**
+ * The large arrays counters and the nodes of a sample of their pages, e.g.
+ * "3 arrays, 96 MB, 96 MB interleaved, pages per node: 0: 24 1: 24".
+ * Transparent huge pages in use by the process are read from
+ * /proc/self/smaps_rollup when the kernel provides it.
+ */
+inline std::string LargeArrayReport() {
+  auto& registry = LargeArrayRegistry::Get();
+  auto stats = registry.stats();
+  auto n_pages = registry.SamplePageNodes(4096);
+  std::ostringstream os;
+  auto mb = [](size_t bytes) { return bytes >> 20; };
+
+  os << stats.n_arrays << " arrays, " << mb(stats.bytes) << " MB, "
+     << mb(stats.explicit_huge_bytes) << " MB explicit huge pages ("
+     << stats.n_explicit_fallbacks << " fallbacks), "
+     << mb(stats.transparent_huge_bytes) << " MB advised huge, "
+     << mb(stats.interleaved_bytes) << " MB interleaved ("
+     << stats.n_interleave_failures << " failures), pages per node:";
+  for (size_t node = 0; node + 1 < n_pages.size(); node++) {
+    os << " " << node << ": " << n_pages[node];
+  }
+  os << " absent: " << n_pages.back();
+
+  std::ifstream fi("/proc/self/smaps_rollup");
+  std::string line;
+
+  while (std::getline(fi, line)) {
+    if (line.compare(0, 14, "AnonHugePages:") == 0) {
+      os << ", AnonHugePages: " << line.substr(line.find_first_not_of(' ', 14));
+    }
+  }
+  return os.str();
+}
+
+}  // namespace her
+#endif  // HER_MEMORY_POLICY_H_
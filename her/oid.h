@@ -0,0 +1,187 @@
+#ifndef HER_OID_H_
+#define HER_OID_H_
+#include <boost/utility/string_view.hpp>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "glog/logging.h"
+#include "her/snapshot.h"
+
+namespace her {
+/**
+ * A list of strings stored back to back in one arena, the i-th string is
+ * arena_[offsets_[i], offsets_[i + 1]). Adding a string costs no allocation
+ * of its own, unlike a vector of strings.
+ */
+class StringList {
+ public:
+  StringList() : offsets_(std::vector<uint64_t>(1, 0)) {}
+
+  void push_back(boost::string_view s) {
+    auto& arena = arena_.Mutable();
+
+    arena.insert(arena.end(), s.begin(), s.end());
+    offsets_.Mutable().push_back(arena.size());
+  }
+
+  void Append(const StringList& other) {
+    auto& arena = arena_.Mutable();
+    auto& offsets = offsets_.Mutable();
+    size_t base = arena.size();
+
+    arena.insert(arena.end(), other.arena_.begin(), other.arena_.end());
+    offsets.reserve(offsets.size() + other.size());
+    for (size_t i = 1; i < other.offsets_.size(); i++) {
+      offsets.push_back(base + other.offsets_[i]);
+    }
+  }
+
+  boost::string_view operator[](size_t i) const {
+    return boost::string_view(arena_.data() + offsets_[i],
+                              offsets_[i + 1] - offsets_[i]);
+  }
+
+  size_t size() const { return offsets_.size() - 1; }
+
+  bool empty() const { return size() == 0; }
+
+  size_t ArenaBytes() const { return arena_.size(); }
+
+  void Serialize(SnapshotWriter& writer) const {
+    writer.WriteArray(arena_.data(), arena_.size());
+    writer.WriteVector(offsets_);
+  }
+
+  // The arena and the offsets are used in place
+  void Deserialize(SnapshotReader& reader) {
+    reader.ReadVector(arena_);
+    reader.ReadVector(offsets_);
+    CHECK(!offsets_.empty() && offsets_.back() == arena_.size())
+        << "Corrupted snapshot";
+  }
+
+ private:
+  CowArray<char> arena_;
+  CowArray<uint64_t> offsets_;
+};
+
+inline bool IsBlankChar(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/**
+ * How the vertex ids of the input files (oids) of type OID_T are parsed and
+ * collected. Integer oids are parsed as decimal numbers, out of range numbers
+ * are rejected.
+ */
+template <typename OID_T>
+struct OidTraits {
+  static_assert(std::is_integral<OID_T>::value,
+                "Integer or string oids are expected");
+  // A parsed oid, it does not own memory
+  using ref_t = OID_T;
+  // The oids of a vertex file in file order
+  using list_t = std::vector<OID_T>;
+
+  /**
+   * Parse the oid starting at p, leading blanks are skipped. On success, p
+   * points to the first character after the oid.
+   */
+  static bool Scan(const char*& p, const char* end, OID_T& oid) {
+    using uoid_t = typename std::make_unsigned<OID_T>::type;
+    const char* q = p;
+    bool negative = false;
+    uoid_t uval = 0;
+
+    while (q < end && IsBlankChar(*q)) {
+      q++;
+    }
+    if (q < end && (*q == '-' || *q == '+')) {
+      negative = *q == '-';
+      q++;
+    }
+
+    // The magnitude of the smallest value exceeds the largest one by one
+    uoid_t limit =
+        negative ? uoid_t(0) - static_cast<uoid_t>(
+                                   std::numeric_limits<OID_T>::min())
+                 : static_cast<uoid_t>(std::numeric_limits<OID_T>::max());
+    const char* digits = q;
+
+    while (q < end && *q >= '0' && *q <= '9') {
+      uoid_t digit = *q - '0';
+
+      if (uval > (limit - digit) / 10) {
+        return false;
+      }
+      uval = uval * 10 + digit;
+      q++;
+    }
+    if (q == digits || (q < end && !IsBlankChar(*q))) {
+      return false;
+    }
+    oid = static_cast<OID_T>(negative ? uoid_t(0) - uval : uval);
+    p = q;
+    return true;
+  }
+
+  static void Append(list_t& list, const list_t& more) {
+    list.insert(list.end(), more.begin(), more.end());
+  }
+};
+
+/**
+ * String oids, e.g. URIs, are blank-free tokens. They are collected into a
+ * StringList and interned by VertexMap<std::string, VID_T>.
+ */
+template <>
+struct OidTraits<std::string> {
+  using ref_t = boost::string_view;
+  using list_t = StringList;
+
+  static bool Scan(const char*& p, const char* end, boost::string_view& oid) {
+    const char* q = p;
+
+    while (q < end && IsBlankChar(*q)) {
+      q++;
+    }
+
+    const char* begin = q;
+
+    while (q < end && !IsBlankChar(*q)) {
+      q++;
+    }
+    if (q == begin) {
+      return false;
+    }
+    oid = boost::string_view(begin, q - begin);
+    p = q;
+    return true;
+  }
+
+  static void Append(list_t& list, const list_t& more) { list.Append(more); }
+};
+
+/**
+ * Parse text holding exactly one oid, e.g. the value of a flag.
+ */
+template <typename OID_T>
+bool ParseOid(const std::string& text, OID_T& oid) {
+  const char* p = text.data();
+  const char* end = p + text.size();
+  typename OidTraits<OID_T>::ref_t ref;
+
+  if (!OidTraits<OID_T>::Scan(p, end, ref)) {
+    return false;
+  }
+  while (p < end && IsBlankChar(*p)) {
+    p++;
+  }
+  oid = OID_T(ref);
+  return p == end;
+}
+
+}  // namespace her
+#endif  // HER_OID_H_
@@ -2,12 +2,20 @@
 #define PARAMATRICSIMULATION_HER_PROCESSING_UTILS_H_
 #include <immintrin.h>
 
+#include <queue>
 #include <sstream>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "boost/algorithm/string.hpp"
+#include "boost/utility/string_view.hpp"
 #include "her/config.h"
+#include "her/label_dictionary.h"
+#include "her/tokenizer.h"
+#include "her/vector_table.h"
+#include "her/word_embedding.h"
+#include "her/worker_pool.h"
 
 namespace her {
 template <typename T>
@@ -18,91 +26,234 @@ inline T CosineSimilarity(const dense_vector_t<T>& A,
   return A.dot(B) / (std::sqrt(A.dot(A)) * std::sqrt(B.dot(B)));
 }
 
+/**
+ * The cosine similarity of two vectors of dimension dim, 0 if either of them
+ * is a zero vector.
+ */
 template <typename T>
-inline dense_vector_t<T> TextToVector(
-    const std::unordered_map<std::string, dense_vector_t<T>>& word_embeddings,
-    const std::string& text) {
-  //  auto unknown_it = word_embeddings.find("unk");
-  size_t word_count = 0, matched_count = 0;
-  dense_vector_t<T> vector;
-  std::vector<std::string> str_vec;
-  boost::algorithm::split(str_vec, text, boost::is_any_of("\t ,;|"),
-                          boost::token_compress_on);
+inline T CosineSimilarity(const T* a, const T* b, size_t dim) {
+  Eigen::Map<const dense_vector_t<T>> va(a, dim), vb(b, dim);
+  T norm = std::sqrt(va.dot(va)) * std::sqrt(vb.dot(vb));
+
+  return norm == 0 ? 0 : va.dot(vb) / norm;
+}
+
+/**
+ * Add word vectors of the words of text to vector and return the number of
+ * words, unknown words are counted but not added.
+ */
+template <typename T>
+inline size_t AccumulateTextVector(const WordEmbedding<T>& word_embeddings,
+                                   boost::string_view text,
+                                   dense_vector_t<T>& vector) {
+  size_t word_count = 0;
 
   // word-wise adding
-  for (auto& token : str_vec) {
-    if (!token.empty()) {
-      auto it = word_embeddings.find(token);
-
-      // unknown word
-      if (it != word_embeddings.end()) {
-        matched_count++;
-        auto& vec_of_word = it->second;
-
-        if (vector.size() == 0) {
-          vector.resize(vec_of_word.size());
-          vector.fill(0);
-        }
-        vector += vec_of_word;
+  ForEachToken(text, [&](boost::string_view token) {
+    auto* row = word_embeddings.Find(token);
+
+    // unknown word
+    if (row != nullptr) {
+      if (vector.size() == 0) {
+        vector.setZero(word_embeddings.dim());
+      }
+      vector += word_embeddings.Row(row);
+    }
+    word_count++;
+  });
+
+  return word_count;
+}
+
+/**
+ * The vector of every word of words, or nullptr if the word is unknown, so
+ * the vector of a token is found by its id.
+ */
+template <typename T>
+std::vector<const T*> MatchWords(const LabelDictionary& words,
+                                 const WordEmbedding<T>& word_embeddings) {
+  std::vector<const T*> word_rows(words.size());
+
+  for (label_id_t id = 0; id < words.size(); id++) {
+    word_rows[id] = word_embeddings.Find(words.Get(id));
+  }
+  return word_rows;
+}
+
+/**
+ * The same as AccumulateTextVector, but the words are given as tokens and
+ * their vectors as returned by MatchWords.
+ */
+template <typename T>
+inline size_t AccumulateTokenVector(const WordEmbedding<T>& word_embeddings,
+                                    const std::vector<const T*>& word_rows,
+                                    TokenTable::token_list_t tokens,
+                                    dense_vector_t<T>& vector) {
+  for (auto token : tokens) {
+    auto* row = word_rows[token];
+
+    if (row != nullptr) {
+      if (vector.size() == 0) {
+        vector.setZero(word_embeddings.dim());
       }
-      word_count++;
+      vector += word_embeddings.Row(row);
     }
   }
 
+  return tokens.size();
+}
+
+/**
+ * Intern the words of every label of labels into vocabulary.
+ */
+inline void CollectWords(const LabelDictionary& labels,
+                         LabelDictionary& vocabulary) {
+  for (label_id_t id = 0; id < labels.size(); id++) {
+    ForEachToken(labels.Get(id), [&vocabulary](boost::string_view word) {
+      vocabulary.Intern(word);
+    });
+  }
+}
+
+template <typename T>
+inline dense_vector_t<T> TextToVector(const WordEmbedding<T>& word_embeddings,
+                                      boost::string_view text) {
+  dense_vector_t<T> vector;
+  size_t word_count = AccumulateTextVector(word_embeddings, text, vector);
+
   if (vector.size() == 0) {
     return vector;
   }
 
-  //  if (unknown_it != word_embeddings.end() && matched_count != word_count) {
-  //    vector += unknown_it->second;
-  //  }
-
   // Average
   vector /= word_count;
 
   return vector;
 }
 
-template <typename VECTOR_T, typename GRAPH_T>
-void FillWordVector(
-    const GRAPH_T& g,
-    const std::unordered_map<std::string, VECTOR_T>& word_embedding,
-    VertexArray<VECTOR_T, GRAPH_T>& word_vector, int parallelism) {
-  auto vertices = g.Vertices();
+/**
+ * Fill the sum of word vectors and the word count of every edge label, so
+ * that the vector of a path is computed without touching its text.
+ */
+template <typename T>
+void FillEdgeLabelVector(const TokenTable& edge_label_tokens,
+                         const LabelDictionary& words,
+                         const WordEmbedding<T>& word_embeddings,
+                         std::vector<dense_vector_t<T>>& label_vector_sum,
+                         std::vector<size_t>& label_word_count) {
+  auto word_rows = MatchWords(words, word_embeddings);
+
+  label_vector_sum.clear();
+  label_vector_sum.resize(edge_label_tokens.size());
+  label_word_count.resize(edge_label_tokens.size());
+
+  for (label_id_t id = 0; id < edge_label_tokens.size(); id++) {
+    label_word_count[id] =
+        AccumulateTokenVector(word_embeddings, word_rows,
+                              edge_label_tokens.Get(id), label_vector_sum[id]);
+  }
+}
 
-  word_vector.Init(vertices);
+/**
+ * The vector of the labels of a path, it equals to TextToVector of the labels
+ * joined by spaces.
+ */
+template <typename T>
+inline dense_vector_t<T> PathToVector(
+    const std::vector<dense_vector_t<T>>& label_vector_sum,
+    const std::vector<size_t>& label_word_count,
+    const edge_label_path_t& path) {
+  dense_vector_t<T> vector;
+  size_t word_count = 0;
 
-  std::vector<std::thread> threads;
-  auto ranges = vertices.ToChunks(parallelism);
+  for (auto label : path) {
+    auto& label_vector = label_vector_sum[label];
 
-  for (auto sub_range : ranges) {
-    threads.push_back(std::thread(
-        [&g, &word_embedding,
-         &word_vector](typename GRAPH_T::vertex_range_t range) {
-          for (auto v : range) {
-            auto& label = g[v];
+    if (label_vector.size() > 0) {
+      if (vector.size() == 0) {
+        vector = label_vector;
+      } else {
+        vector += label_vector;
+      }
+    }
+    word_count += label_word_count[label];
+  }
 
-            word_vector[v] = TextToVector(word_embedding, label);
-          }
-        },
-        sub_range));
+  if (vector.size() == 0) {
+    return vector;
   }
 
-  for (auto& th : threads) {
-    th.join();
+  vector /= word_count;
+
+  return vector;
+}
+
+/**
+ * Fill the average word vector of every label of the label pool of g, the
+ * vector of label i is row i of label_vector. Labels without known words get
+ * a zero vector.
+ */
+template <typename T, typename GRAPH_T>
+void FillLabelVector(const GRAPH_T& g, const WordEmbedding<T>& word_embedding,
+                     VectorTable<T>& label_vector, int parallelism) {
+  auto& label_tokens = g.label_tokens();
+  auto word_rows = MatchWords(g.word_dict(), word_embedding);
+  size_t n_labels = label_tokens.size();
+  size_t n_threads = std::max(parallelism, 1);
+  size_t chunk_size = (n_labels + n_threads - 1) / n_threads;
+
+  label_vector.Init(n_labels, word_embedding.dim());
+
+  ParallelFor(n_threads, [&](size_t i) {
+    size_t begin = std::min(i * chunk_size, n_labels);
+    size_t end = std::min(begin + chunk_size, n_labels);
+    dense_vector_t<T> vector;
+
+    for (size_t label = begin; label < end; label++) {
+      vector.resize(0);
+      size_t word_count = AccumulateTokenVector(
+          word_embedding, word_rows, label_tokens.Get(label), vector);
+
+      // Average
+      if (vector.size() > 0) {
+        vector /= word_count;
+        std::copy_n(vector.data(), vector.size(),
+                    label_vector.MutableRowData(label));
+      }
+    }
+  });
+}
+
+/**
+ * Fill the vectors of the labels added to g after label_vector was filled,
+ * e.g. by a delta. The vectors of other labels are kept.
+ */
+template <typename T, typename GRAPH_T>
+void ExtendLabelVector(const GRAPH_T& g,
+                       const WordEmbedding<T>& word_embedding,
+                       VectorTable<T>& label_vector) {
+  auto& label_dict = g.label_dict();
+  label_id_t begin = label_vector.size();
+
+  label_vector.Grow(label_dict.size());
+  for (label_id_t label = begin; label < label_dict.size(); label++) {
+    auto vector = TextToVector(word_embedding, label_dict.Get(label));
+
+    if (vector.size() > 0) {
+      std::copy_n(vector.data(), vector.size(),
+                  label_vector.MutableRowData(label));
+    }
   }
 }
 
 template <typename COORD_T, typename GRAPH_T>
 std::vector<dense_vector_t<COORD_T>> ExtractPoints(
-    const std::unordered_map<std::string, dense_vector_t<COORD_T>>&
-        word_embeddings,
-    const GRAPH_T& g, const typename GRAPH_T::vertex_range_t& vertices) {
+    const WordEmbedding<COORD_T>& word_embeddings, const GRAPH_T& g,
+    const typename GRAPH_T::vertex_range_t& vertices) {
   std::vector<dense_vector_t<COORD_T>> points;
 
   for (auto v : vertices) {
-    auto& label = g[v];
-    auto point = TextToVector(word_embeddings, label);
+    auto point = TextToVector(word_embeddings, g.GetLabel(v));
 
     if (point.size() > 0) {
       points.push_back(point);
@@ -112,14 +263,22 @@ std::vector<dense_vector_t<COORD_T>> ExtractPoints(
   return points;
 }
 
+/**
+ * The vertices within depth_limit hops of src with their depths, in the order
+ * they are reached, at most k of them. A hop follows an out-edge, only one
+ * with a label flagged by edge_labels unless it is empty.
+ */
 template <typename GRAPH_T>
 inline std::vector<std::pair<typename GRAPH_T::vertex_t, depth_t>> BFS(
     const GRAPH_T& g, typename GRAPH_T::vertex_t src, depth_t depth_limit,
-    size_t k = std::numeric_limits<size_t>::max()) {
+    size_t k = std::numeric_limits<size_t>::max(),
+    const std::vector<bool>& edge_labels = {}) {
+  using vertex_t = typename GRAPH_T::vertex_t;
+  using edata_t = typename GRAPH_T::edata_t;
   depth_t curr_depth = 0;
-  std::queue<typename GRAPH_T::vertex_t> queue;
-  std::unordered_set<typename GRAPH_T::vertex_t> visited;
-  std::vector<std::pair<typename GRAPH_T::vertex_t, depth_t>> descendants;
+  std::queue<vertex_t> queue;
+  std::unordered_set<vertex_t> visited;
+  std::vector<std::pair<vertex_t, depth_t>> descendants;
 
   queue.push(src);
 
@@ -130,19 +289,20 @@ inline std::vector<std::pair<typename GRAPH_T::vertex_t, depth_t>> BFS(
       auto u = queue.front();
       queue.pop();
 
-      auto oes = g.GetOutgoingAdjList(u);
-      for (auto& e : oes) {
-        auto v = g.target(e);
+      bool complete =
+          g.VisitOutEdges(u, edge_labels, [&](vertex_t v, edata_t) {
+            if (visited.find(v) == visited.end()) {
+              queue.push(v);
+              descendants.template emplace_back(v, curr_depth);
+              visited.insert(v);
 
-        if (visited.find(v) == visited.end()) {
-          queue.push(v);
-          descendants.template emplace_back(v, curr_depth);
-          visited.insert(v);
+              return descendants.size() < k;
+            }
+            return true;
+          });
 
-          if (descendants.size() >= k) {
-            return descendants;
-          }
-        }
+      if (!complete) {
+        return descendants;
       }
     }
     curr_depth++;
@@ -151,6 +311,53 @@ inline std::vector<std::pair<typename GRAPH_T::vertex_t, depth_t>> BFS(
   return descendants;
 }
 
+/**
+ * Flag the vertices reachable from sources within depth_limit hops, or at any
+ * depth if depth_limit is negative. A hop follows an out-edge, or an entry of
+ * descendants if it is not empty, as h_r does with a descendant file.
+ */
+template <typename GRAPH_T>
+std::vector<bool> ReachableVertices(
+    const GRAPH_T& g, const std::vector<typename GRAPH_T::vertex_t>& sources,
+    int depth_limit,
+    const std::vector<std::vector<std::pair<typename GRAPH_T::vertex_t,
+                                            depth_t>>>& descendants) {
+  std::vector<bool> reached(g.Vertices().size(), false);
+  std::vector<typename GRAPH_T::vertex_t> frontier, next;
+
+  for (auto v : sources) {
+    reached[v] = true;
+    frontier.push_back(v);
+  }
+
+  for (int depth = 0; !frontier.empty() && depth != depth_limit; depth++) {
+    auto visit = [&reached, &next](typename GRAPH_T::vertex_t v) {
+      if (!reached[v]) {
+        reached[v] = true;
+        next.push_back(v);
+      }
+    };
+
+    for (auto u : frontier) {
+      for (auto& e : g.GetOutgoingAdjList(u)) {
+        visit(g.target(e));
+      }
+      if (!descendants.empty()) {
+        for (auto& desc : descendants[u]) {
+          visit(desc.first);
+        }
+      }
+    }
+    frontier.swap(next);
+    next.clear();
+  }
+  return reached;
+}
+
+/**
+ * Split vec into n_chunks chunks of size / n_chunks elements, the last chunk
+ * takes the rest. Chunks are empty if vec has less than n_chunks elements.
+ */
 template <typename T>
 inline std::vector<std::pair<typename std::vector<T>::const_iterator,
                              typename std::vector<T>::const_iterator>>
@@ -161,8 +368,6 @@ ToChunks(const std::vector<T>& vec, size_t n_chunks) {
   size_t size = vec.size();
   size_t chunk_size = size / n_chunks;
 
-  CHECK_GT(chunk_size, 0) << "Too many chunks";
-
   for (size_t i = 0; i < n_chunks; i++) {
     auto begin = vec.begin() + i * chunk_size;
     auto end = vec.begin() + (i + 1) * chunk_size;
@@ -177,49 +382,49 @@ ToChunks(const std::vector<T>& vec, size_t n_chunks) {
   return chunks;
 }
 
+/**
+ * The edge labels along a shortest path from src to dst, or an empty path if
+ * dst is unreachable. Only edges with a label flagged by edge_labels are
+ * followed unless it is empty.
+ */
 template <typename GRAPH_T>
-inline std::string ConcatEdgeLabel(const GRAPH_T& g,
-                                   typename GRAPH_T::vertex_t src,
-                                   typename GRAPH_T::vertex_t dst,
-                                   const std::string& delimiter) {
+inline std::vector<typename GRAPH_T::edata_t> ConcatEdgeLabel(
+    const GRAPH_T& g, typename GRAPH_T::vertex_t src,
+    typename GRAPH_T::vertex_t dst,
+    const std::vector<bool>& edge_labels = {}) {
   using vertex_t = typename GRAPH_T::vertex_t;
-  using edge_t = typename GRAPH_T::edge_t;
-  std::queue<std::pair<vertex_t, std::vector<edge_t>>> queue;
+  using edata_t = typename GRAPH_T::edata_t;
+  std::queue<std::pair<vertex_t, std::vector<edata_t>>> queue;
   std::unordered_set<vertex_t> visited;
+  std::vector<edata_t> path;
 
-  queue.push(std::make_pair(src, std::vector<edge_t>()));
+  queue.push(std::make_pair(src, std::vector<edata_t>()));
 
   while (!queue.empty()) {
     auto pair = queue.front();
     auto u = pair.first;
     auto& src_path = pair.second;
-    auto oes = g.GetOutgoingAdjList(u);
-
-    for (auto& oe : oes) {
-      auto v = g.target(oe);
-
-      if (visited.find(v) == visited.end()) {
-        visited.insert(v);
-        queue.template emplace(v, src_path);
-
-        auto& dst_path = queue.back().second;
+    bool found =
+        !g.VisitOutEdges(u, edge_labels, [&](vertex_t v, edata_t data) {
+          if (visited.find(v) == visited.end()) {
+            visited.insert(v);
+            queue.template emplace(v, src_path);
 
-        dst_path.push_back(oe);
+            auto& dst_path = queue.back().second;
 
-        if (v == dst) {
-          std::vector<std::string> tokens(dst_path.size());
+            dst_path.push_back(data);
 
-          for (size_t i = 0; i < dst_path.size(); i++) {
-            auto& e = dst_path[i];
-
-            tokens[i] = g[e];
+            if (v == dst) {
+              path = dst_path;
+              return false;
+            }
           }
+          return true;
+        });
 
-          return boost::algorithm::join(tokens, delimiter);
-        }
-      }
+    if (found) {
+      return path;
     }
-
     queue.pop();
   }
 
@@ -0,0 +1,165 @@
+#ifndef HER_REORDER_H_
+#define HER_REORDER_H_
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace her {
+/**
+ * How the vertices of a loaded graph are renumbered, see -reorder. Vertices
+ * close to each other in the graph get close ids, so traversals touch fewer
+ * cache lines of the CSR and of per-vertex arrays.
+ */
+enum class ReorderMethod {
+  // Keep the order of the vertex file
+  kNone,
+  // Breadth-first order over out- and in-edges, started at vertices in id
+  // order
+  kBfs,
+  // Reverse Cuthill-McKee: breadth-first from vertices of low degree, the
+  // neighbors of a vertex are visited by increasing degree, and the whole
+  // order is reversed
+  kRcm,
+  // By decreasing degree, so the hubs share the first cache lines
+  kDegree
+};
+
+inline bool ParseReorderMethod(const std::string& name,
+                               ReorderMethod& method) {
+  if (name == "none") {
+    method = ReorderMethod::kNone;
+  } else if (name == "bfs") {
+    method = ReorderMethod::kBfs;
+  } else if (name == "rcm") {
+    method = ReorderMethod::kRcm;
+  } else if (name == "degree") {
+    method = ReorderMethod::kDegree;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * The distances |u - v| between the ids of the ends of edges (u, v), a
+ * measure of how local the traversals of a graph are.
+ */
+struct EdgeGaps {
+  double mean{};
+  // The mean of log2(|u - v| + 1), it is not dominated by a few long edges
+  double mean_log2{};
+};
+
+template <typename GRAPH_T>
+EdgeGaps MeasureEdgeGaps(const GRAPH_T& g) {
+  EdgeGaps gaps;
+  size_t n_edges = 0;
+
+  for (auto u : g.Vertices()) {
+    for (auto v : g.OutNeighbors(u)) {
+      double gap = u > v ? u - v : v - u;
+
+      gaps.mean += gap;
+      gaps.mean_log2 += std::log2(gap + 1);
+      n_edges++;
+    }
+  }
+  if (n_edges > 0) {
+    gaps.mean /= n_edges;
+    gaps.mean_log2 /= n_edges;
+  }
+  return gaps;
+}
+
+/**
+ * The new id of every vertex of g, indexed by its current id, as ordered by
+ * method. Edges are taken as undirected, so the in-edges of g are built by
+ * parallelism threads.
+ */
+template <typename GRAPH_T>
+std::vector<typename GRAPH_T::vertex_t> ReorderVertices(const GRAPH_T& g,
+                                                        ReorderMethod method,
+                                                        int parallelism) {
+  using vertex_t = typename GRAPH_T::vertex_t;
+  size_t n_vertices = g.Vertices().size();
+  std::vector<vertex_t> order;  // the current ids, in the new order
+  std::vector<size_t> degree(n_vertices);
+
+  g.BuildInEdges(parallelism);
+  for (auto v : g.Vertices()) {
+    degree[v] = g.OutDegree(v) + g.InDegree(v);
+  }
+  order.reserve(n_vertices);
+
+  if (method == ReorderMethod::kNone) {
+    for (auto v : g.Vertices()) {
+      order.push_back(v);
+    }
+  } else if (method == ReorderMethod::kDegree) {
+    for (auto v : g.Vertices()) {
+      order.push_back(v);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&degree](vertex_t a, vertex_t b) {
+                       return degree[a] > degree[b];
+                     });
+  } else {
+    bool rcm = method == ReorderMethod::kRcm;
+    std::vector<bool> visited(n_vertices, false);
+    std::vector<vertex_t> starts, neighbors;
+    auto by_degree = [&degree](vertex_t a, vertex_t b) {
+      return degree[a] < degree[b];
+    };
+
+    for (auto v : g.Vertices()) {
+      starts.push_back(v);
+    }
+    if (rcm) {
+      std::stable_sort(starts.begin(), starts.end(), by_degree);
+    }
+    // order is the queue of the breadth-first searches
+    for (auto start : starts) {
+      if (visited[start]) {
+        continue;
+      }
+      visited[start] = true;
+      order.push_back(start);
+      for (size_t head = order.size() - 1; head < order.size(); head++) {
+        auto u = order[head];
+
+        neighbors.clear();
+        for (auto v : g.OutNeighbors(u)) {
+          if (!visited[v]) {
+            visited[v] = true;
+            neighbors.push_back(v);
+          }
+        }
+        for (auto v : g.InNeighbors(u)) {
+          if (!visited[v]) {
+            visited[v] = true;
+            neighbors.push_back(v);
+          }
+        }
+        if (rcm) {
+          std::stable_sort(neighbors.begin(), neighbors.end(), by_degree);
+        }
+        order.insert(order.end(), neighbors.begin(), neighbors.end());
+      }
+    }
+    if (rcm) {
+      std::reverse(order.begin(), order.end());
+    }
+  }
+
+  std::vector<vertex_t> new_ids(n_vertices);
+
+  for (size_t i = 0; i < n_vertices; i++) {
+    new_ids[order[i]] = i;
+  }
+  return new_ids;
+}
+
+}  // namespace her
+#endif  // HER_REORDER_H_
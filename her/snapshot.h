@@ -0,0 +1,364 @@
+#ifndef HER_SNAPSHOT_H_
+#define HER_SNAPSHOT_H_
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+#include "her/mapped_file.h"
+
+namespace her {
+/**
+ * A snapshot is a flat binary file holding the fully prepared engine state.
+ * It starts with a fixed header followed by sections written in a fixed
+ * order, every section is padded to kSnapshotAlignment bytes. Bump
+ * kSnapshotVersion whenever the layout of any section changes.
+ */
+static constexpr char kSnapshotMagic[8] = {'H', 'E', 'R', 'S',
+                                           'N', 'A', 'P', '\0'};
+static constexpr uint32_t kSnapshotVersion = 14;
+static constexpr size_t kSnapshotAlignment = 64;
+
+/**
+ * Return true if path is a snapshot file of the current version.
+ */
+inline bool IsSnapshotFile(const std::string& path) {
+  std::ifstream fi(path, std::ios::binary);
+  char magic[sizeof(kSnapshotMagic)];
+  uint32_t version;
+
+  fi.read(magic, sizeof(magic));
+  fi.read(reinterpret_cast<char*>(&version), sizeof(version));
+  return fi.good() && memcmp(magic, kSnapshotMagic, sizeof(magic)) == 0 &&
+         version == kSnapshotVersion;
+}
+
+/**
+ * A read-only array that either owns its elements or points into a mapped
+ * snapshot file. Copies share the elements.
+ */
+template <typename T>
+class SharedArray {
+ public:
+  SharedArray() = default;
+
+  template <typename ALLOC_T>
+  explicit SharedArray(std::vector<T, ALLOC_T>&& vec) {
+    auto holder = std::make_shared<std::vector<T, ALLOC_T>>(std::move(vec));
+
+    data_ = holder->data();
+    size_ = holder->size();
+    owner_ = holder;
+  }
+
+  SharedArray(const T* data, size_t size, std::shared_ptr<const void> owner)
+      : data_(data), size_(size), owner_(owner) {}
+
+  const T* data() const { return data_; }
+
+  size_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+  const T* begin() const { return data_; }
+
+  const T* end() const { return data_ + size_; }
+
+  const T& operator[](size_t i) const { return data_[i]; }
+
+ private:
+  const T* data_{};
+  size_t size_{};
+  std::shared_ptr<const void> owner_;
+};
+
+/**
+ * An array that is either owned, or used in place from a mapped snapshot like
+ * a SharedArray. Reading never copies, so ranks mapping the same snapshot
+ * share its pages. The first Mutable() copies a mapped array into an owned
+ * vector, a rank only pays for its own copy once it changes the array.
+ */
+template <typename T, typename ALLOC_T = std::allocator<T>>
+class CowArray {
+ public:
+  using vector_t = std::vector<T, ALLOC_T>;
+
+  CowArray() = default;
+
+  explicit CowArray(vector_t&& vec) : owned_(std::move(vec)) {}
+
+  CowArray& operator=(vector_t&& vec) {
+    owned_ = std::move(vec);
+    mapped_ = SharedArray<T>();
+    is_mapped_ = false;
+    return *this;
+  }
+
+  // Use arr in place
+  void Map(const SharedArray<T>& arr) {
+    owned_ = vector_t();
+    mapped_ = arr;
+    is_mapped_ = true;
+  }
+
+  const T* data() const { return is_mapped_ ? mapped_.data() : owned_.data(); }
+
+  size_t size() const { return is_mapped_ ? mapped_.size() : owned_.size(); }
+
+  bool empty() const { return size() == 0; }
+
+  const T* begin() const { return data(); }
+
+  const T* end() const { return data() + size(); }
+
+  const T& operator[](size_t i) const { return data()[i]; }
+
+  const T& back() const { return data()[size() - 1]; }
+
+  // The owned vector, a mapped array is copied into it first
+  vector_t& Mutable() {
+    if (is_mapped_) {
+      owned_.assign(mapped_.begin(), mapped_.end());
+      mapped_ = SharedArray<T>();
+      is_mapped_ = false;
+    }
+    return owned_;
+  }
+
+  void swap(CowArray& other) {
+    owned_.swap(other.owned_);
+    std::swap(mapped_, other.mapped_);
+    std::swap(is_mapped_, other.is_mapped_);
+  }
+
+ private:
+  vector_t owned_;
+  SharedArray<T> mapped_;
+  bool is_mapped_{};
+};
+
+class SnapshotWriter {
+ public:
+  explicit SnapshotWriter(const std::string& path)
+      : path_(path), tmp_path_(path + ".tmp") {
+    fo_.open(tmp_path_, std::ios::binary | std::ios::trunc);
+    CHECK(fo_.is_open()) << "Failed to open " << tmp_path_;
+    fo_.write(kSnapshotMagic, sizeof(kSnapshotMagic));
+    WritePod(kSnapshotVersion);
+  }
+
+  /**
+   * Flush the content and move the file to its final path, so a reader never
+   * sees a partially written snapshot.
+   */
+  void Close() {
+    fo_.close();
+    CHECK(!fo_.fail()) << "Failed to write " << tmp_path_;
+    CHECK_EQ(std::rename(tmp_path_.c_str(), path_.c_str()), 0)
+        << "Failed to rename " << tmp_path_ << " to " << path_;
+  }
+
+  template <typename T>
+  void WritePod(const T& val) {
+    static_assert(std::is_trivially_copyable<T>::value, "POD is expected");
+    fo_.write(reinterpret_cast<const char*>(&val), sizeof(T));
+    offset_ += sizeof(T);
+  }
+
+  template <typename T>
+  void WriteArray(const T* data, size_t size) {
+    static_assert(std::is_trivially_copyable<T>::value, "POD is expected");
+    WritePod<uint64_t>(size);
+    Align();
+    fo_.write(reinterpret_cast<const char*>(data), sizeof(T) * size);
+    offset_ += sizeof(T) * size;
+    Align();
+  }
+
+  // Write the concatenation of (data, size) pieces as one array
+  template <typename T>
+  void WriteArrays(const std::vector<std::pair<const T*, size_t>>& pieces) {
+    static_assert(std::is_trivially_copyable<T>::value, "POD is expected");
+    size_t size = 0;
+
+    for (auto& piece : pieces) {
+      size += piece.second;
+    }
+    WritePod<uint64_t>(size);
+    Align();
+    for (auto& piece : pieces) {
+      fo_.write(reinterpret_cast<const char*>(piece.first),
+                sizeof(T) * piece.second);
+    }
+    offset_ += sizeof(T) * size;
+    Align();
+  }
+
+  template <typename T, typename ALLOC_T>
+  void WriteVector(const std::vector<T, ALLOC_T>& vec) {
+    WriteArray(vec.data(), vec.size());
+  }
+
+  void WriteVector(const std::vector<std::string>& vec) { WriteStrings(vec); }
+
+  template <typename T>
+  void WriteVector(const SharedArray<T>& arr) {
+    WriteArray(arr.data(), arr.size());
+  }
+
+  template <typename T, typename ALLOC_T>
+  void WriteVector(const CowArray<T, ALLOC_T>& arr) {
+    WriteArray(arr.data(), arr.size());
+  }
+
+  template <typename STRINGS_T>
+  void WriteStrings(const STRINGS_T& strings) {
+    std::vector<uint64_t> offsets;
+    std::string arena;
+
+    offsets.reserve(strings.size() + 1);
+    offsets.push_back(0);
+    for (auto& s : strings) {
+      arena.append(s);
+      offsets.push_back(arena.size());
+    }
+    WriteVector(offsets);
+    WriteArray(arena.data(), arena.size());
+  }
+
+ private:
+  void Align() {
+    static const char padding[kSnapshotAlignment] = {};
+    size_t rem = offset_ % kSnapshotAlignment;
+
+    if (rem != 0) {
+      fo_.write(padding, kSnapshotAlignment - rem);
+      offset_ += kSnapshotAlignment - rem;
+    }
+  }
+
+  std::string path_;
+  std::string tmp_path_;
+  std::ofstream fo_;
+  size_t offset_{sizeof(kSnapshotMagic)};
+};
+
+class SnapshotReader {
+ public:
+  explicit SnapshotReader(const std::string& path)
+      : file_(std::make_shared<MappedFile>(path, MADV_NORMAL)) {
+    CHECK(file_->size() >= sizeof(kSnapshotMagic) &&
+          memcmp(file_->begin(), kSnapshotMagic, sizeof(kSnapshotMagic)) == 0)
+        << path << " is not a snapshot file";
+    pos_ = file_->begin() + sizeof(kSnapshotMagic);
+
+    auto version = ReadPod<uint32_t>();
+
+    CHECK_EQ(version, kSnapshotVersion)
+        << "Snapshot " << path << " has version " << version
+        << ", but version " << kSnapshotVersion
+        << " is expected. Please regenerate it with -snapshot_out";
+  }
+
+  template <typename T>
+  T ReadPod() {
+    static_assert(std::is_trivially_copyable<T>::value, "POD is expected");
+    T val;
+
+    Ensure(sizeof(T));
+    memcpy(&val, pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return val;
+  }
+
+  /**
+   * Return a pointer into the mapped file, the data is valid as long as the
+   * reader or a copy of file() is alive. The data is aligned to
+   * kSnapshotAlignment bytes.
+   */
+  template <typename T>
+  const T* ReadArray(size_t& size) {
+    size = ReadPod<uint64_t>();
+    Align();
+    Ensure(sizeof(T) * size);
+    auto* data = reinterpret_cast<const T*>(pos_);
+    pos_ += sizeof(T) * size;
+    Align();
+    return data;
+  }
+
+  template <typename T, typename ALLOC_T>
+  void ReadVector(std::vector<T, ALLOC_T>& vec) {
+    size_t size;
+    auto* data = ReadArray<T>(size);
+
+    vec.assign(data, data + size);
+  }
+
+  void ReadVector(std::vector<std::string>& vec) { ReadStrings(vec); }
+
+  // The array is used in place, it keeps the mapping alive
+  template <typename T>
+  void ReadVector(SharedArray<T>& arr) {
+    size_t size;
+    auto* data = ReadArray<T>(size);
+
+    arr = SharedArray<T>(data, size, file_);
+  }
+
+  // The array is used in place until it is changed, see CowArray
+  template <typename T, typename ALLOC_T>
+  void ReadVector(CowArray<T, ALLOC_T>& arr) {
+    size_t size;
+    auto* data = ReadArray<T>(size);
+
+    arr.Map(SharedArray<T>(data, size, file_));
+  }
+
+  void ReadStrings(std::vector<std::string>& strings) {
+    size_t n_offsets, arena_size;
+    auto* offsets = ReadArray<uint64_t>(n_offsets);
+    auto* arena = ReadArray<char>(arena_size);
+
+    CHECK_GT(n_offsets, 0) << "Corrupted snapshot";
+    CHECK_EQ(offsets[n_offsets - 1], arena_size) << "Corrupted snapshot";
+    strings.clear();
+    strings.reserve(n_offsets - 1);
+    for (size_t i = 0; i + 1 < n_offsets; i++) {
+      strings.emplace_back(arena + offsets[i], arena + offsets[i + 1]);
+    }
+  }
+
+  bool AtEnd() const { return pos_ == file_->end(); }
+
+  // The mapping, kept by data used in place after the reader is gone
+  std::shared_ptr<const MappedFile> file() const { return file_; }
+
+ private:
+  void Ensure(size_t n) const {
+    CHECK_LE(n, static_cast<size_t>(file_->end() - pos_))
+        << "Truncated snapshot";
+  }
+
+  void Align() {
+    size_t offset = pos_ - file_->begin();
+    size_t rem = offset % kSnapshotAlignment;
+
+    if (rem != 0) {
+      pos_ += std::min<size_t>(kSnapshotAlignment - rem, file_->end() - pos_);
+    }
+  }
+
+  std::shared_ptr<MappedFile> file_;
+  const char* pos_{};
+};
+
+}  // namespace her
+#endif  // HER_SNAPSHOT_H_
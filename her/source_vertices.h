@@ -0,0 +1,78 @@
+#ifndef HER_SOURCE_VERTICES_H_
+#define HER_SOURCE_VERTICES_H_
+#include <algorithm>
+#include <vector>
+
+#include "glog/logging.h"
+
+namespace her {
+/**
+ * The source entities of a graph: vertices having out-edges whose label is a
+ * source label. Membership is one bit per vertex, and the sorted list of the
+ * source vertices lets candidate generation skip all other vertices.
+ */
+template <typename GRAPH_T>
+class SourceVertices {
+  using vertex_t = typename GRAPH_T::vertex_t;
+
+ public:
+  /**
+   * label_flags flags the label ids of g that are source labels, see
+   * ResolveSourceLabels.
+   */
+  void Init(const GRAPH_T& g, const std::vector<bool>& label_flags) {
+    flags_.assign(g.Vertices().size(), false);
+    vertices_.clear();
+    for (auto v : g.Vertices()) {
+      if (IsSource(g, label_flags, v)) {
+        flags_[v] = true;
+        vertices_.push_back(v);
+      }
+    }
+  }
+
+  /**
+   * Update the vertices touched by a delta applied to g, label_flags must
+   * cover the labels added by the delta.
+   */
+  void Update(const GRAPH_T& g, const std::vector<bool>& label_flags,
+              const typename GRAPH_T::update_t& update) {
+    flags_.resize(g.Vertices().size(), false);
+    for (auto v : update.vertices) {
+      bool is_source = IsSource(g, label_flags, v);
+
+      if (is_source == flags_[v]) {
+        continue;
+      }
+      flags_[v] = is_source;
+
+      auto it = std::lower_bound(vertices_.begin(), vertices_.end(), v);
+
+      if (is_source) {
+        vertices_.insert(it, v);
+      } else {
+        CHECK(it != vertices_.end() && *it == v);
+        vertices_.erase(it);
+      }
+    }
+  }
+
+  bool Contains(vertex_t v) const { return flags_[v]; }
+
+  // The source vertices in ascending order
+  const std::vector<vertex_t>& vertices() const { return vertices_; }
+
+  size_t size() const { return vertices_.size(); }
+
+ private:
+  static bool IsSource(const GRAPH_T& g, const std::vector<bool>& label_flags,
+                       vertex_t v) {
+    return g.OutDegree(v) > 0 && label_flags[g[v]];
+  }
+
+  std::vector<bool> flags_;
+  std::vector<vertex_t> vertices_;
+};
+
+}  // namespace her
+#endif  // HER_SOURCE_VERTICES_H_
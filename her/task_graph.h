@@ -0,0 +1,139 @@
+#ifndef HER_TASK_GRAPH_H_
+#define HER_TASK_GRAPH_H_
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+#include "her/util.h"
+#include "her/worker_pool.h"
+
+namespace her {
+/**
+ * A set of tasks with dependencies, run by a pool of worker threads. A task
+ * starts as soon as all tasks it depends on are finished and a worker is
+ * free, so independent tasks overlap. Tasks may only depend on tasks added
+ * before them, the graph is therefore acyclic. The start and end time of
+ * every task is recorded.
+ */
+class TaskGraph {
+ public:
+  using task_id_t = size_t;
+
+  struct Task {
+    std::string name;
+    std::function<void()> func;
+    std::vector<task_id_t> dependents;
+    size_t n_deps{};
+    double start{};
+    double end{};
+  };
+
+  task_id_t AddTask(const std::string& name, std::function<void()> func,
+                    const std::vector<task_id_t>& deps = {}) {
+    task_id_t id = tasks_.size();
+
+    tasks_.emplace_back();
+    tasks_[id].name = name;
+    tasks_[id].func = std::move(func);
+    tasks_[id].n_deps = deps.size();
+    for (auto dep : deps) {
+      CHECK_LT(dep, id) << "Task " << name << " depends on a later task";
+      tasks_[dep].dependents.push_back(id);
+    }
+    return id;
+  }
+
+  /**
+   * Run all tasks by a WorkerPool of n_workers workers, return when every
+   * task is finished. The parallel loops of the tasks, see ParallelFor, are
+   * run by the same workers, so a worker freed by one task helps the loops
+   * of the tasks still running.
+   */
+  void Run(size_t n_workers) {
+    std::vector<size_t> n_pending(tasks_.size());
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t n_finished = 0;
+    std::function<void(task_id_t)> submit;
+    // Declared last, so its workers are stopped before the state they use
+    // is destroyed
+    WorkerPool pool(n_workers);
+
+    submit = [&](task_id_t id) {
+      pool.Submit([&, id]() {
+        auto& task = tasks_[id];
+
+        task.start = GetCurrentTime();
+        task.func();
+        task.end = GetCurrentTime();
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        n_finished++;
+        for (auto dependent : task.dependents) {
+          if (--n_pending[dependent] == 0) {
+            submit(dependent);
+          }
+        }
+        cv.notify_all();
+      });
+    };
+
+    start_ = GetCurrentTime();
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+
+      for (task_id_t id = 0; id < tasks_.size(); id++) {
+        n_pending[id] = tasks_[id].n_deps;
+        if (n_pending[id] == 0) {
+          submit(id);
+        }
+      }
+      cv.wait(lock, [&]() { return n_finished == tasks_.size(); });
+    }
+    end_ = GetCurrentTime();
+  }
+
+  const std::vector<Task>& tasks() const { return tasks_; }
+
+  size_t size() const { return tasks_.size(); }
+
+  // Wall time of the last Run
+  double ElapsedTime() const { return end_ - start_; }
+
+  /**
+   * The sum of the run time of all tasks, it exceeds ElapsedTime() by the
+   * time that is saved by overlapping.
+   */
+  double TaskTime() const {
+    double time = 0;
+
+    for (auto& task : tasks_) {
+      time += task.end - task.start;
+    }
+    return time;
+  }
+
+  /**
+   * Log when each task started relative to Run and how long it took.
+   */
+  void LogTiming(const std::string& title) const {
+    LOG(INFO) << title << ": " << ElapsedTime() << " sec, tasks " << TaskTime()
+              << " sec";
+    for (auto& task : tasks_) {
+      LOG(INFO) << " - " << task.name << ": +" << task.start - start_
+                << " sec, " << task.end - task.start << " sec";
+    }
+  }
+
+ private:
+  std::vector<Task> tasks_;
+  double start_{};
+  double end_{};
+};
+
+}  // namespace her
+#endif  // HER_TASK_GRAPH_H_
@@ -40,7 +40,7 @@
  * Timers for LDBC benchmarking, referred and derived from project
  * atlarge-research/graphalytics-platforms-powergraph.
  */
-static double timer() {
+static inline double timer() {
   struct timeval tv;
   gettimeofday(&tv, NULL);
   return tv.tv_sec + tv.tv_usec / 1000000.0;
@@ -49,24 +49,24 @@ static double timer() {
 static bool timer_enabled;
 static std::vector<std::pair<std::string, double>> timers;
 
-static void timer_start(bool enabled = true) {
+static inline void timer_start(bool enabled = true) {
   timers.clear();
   timer_enabled = enabled;
 }
 
-static void timer_next(const std::string& name) {
+static inline void timer_next(const std::string& name) {
   if (timer_enabled) {
     timers.emplace_back(std::make_pair(name, timer()));
   }
 }
 
-static void timer_next(const std::string& name, double abs_time) {
+static inline void timer_next(const std::string& name, double abs_time) {
   if (timer_enabled) {
     timers.emplace_back(std::make_pair(name, -abs_time));
   }
 }
 
-static void timer_end() {
+static inline void timer_end() {
   if (timer_enabled) {
     timer_next("end");
 
@@ -0,0 +1,136 @@
+#ifndef HER_TOKENIZER_H_
+#define HER_TOKENIZER_H_
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <boost/range/iterator_range.hpp>
+#include <boost/utility/string_view.hpp>
+#include <vector>
+
+#include "glog/logging.h"
+#include "her/label_dictionary.h"
+#include "her/snapshot.h"
+
+namespace her {
+/**
+ * Return true if [p, end) contains an upper-case ASCII letter.
+ */
+inline bool HasUpperAscii(const char* p, const char* end) {
+  for (; p < end; p++) {
+    if (*p >= 'A' && *p <= 'Z') {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Lower-case the ASCII letters of [p, end) in place, other bytes are kept.
+ * 16 bytes are converted at a time when SSE2 is available.
+ */
+inline void ToLowerAscii(char* p, char* end) {
+#ifdef __SSE2__
+  const __m128i before_a = _mm_set1_epi8('A' - 1);
+  const __m128i after_z = _mm_set1_epi8('Z' + 1);
+  const __m128i to_lower = _mm_set1_epi8('a' - 'A');
+
+  for (; end - p >= 16; p += 16) {
+    __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    // bytes above 0x7f are negative, so they are never taken as letters
+    __m128i is_upper = _mm_and_si128(_mm_cmpgt_epi8(chars, before_a),
+                                     _mm_cmplt_epi8(chars, after_z));
+
+    chars = _mm_add_epi8(chars, _mm_and_si128(is_upper, to_lower));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), chars);
+  }
+#endif
+  for (; p < end; p++) {
+    if (*p >= 'A' && *p <= 'Z') {
+      *p = *p - 'A' + 'a';
+    }
+  }
+}
+
+/**
+ * Call func(token) for every non-empty word of text, the words of a label
+ * are separated by blanks and punctuations.
+ */
+template <typename FUNC_T>
+inline void ForEachToken(boost::string_view text, const FUNC_T& func) {
+  static const char kDelimiters[] = "\t ,;|";
+  size_t begin = 0;
+
+  while (begin < text.size()) {
+    size_t end = text.find_first_of(kDelimiters, begin);
+
+    if (end == boost::string_view::npos) {
+      end = text.size();
+    }
+    if (end > begin) {
+      func(text.substr(begin, end - begin));
+    }
+    begin = end + 1;
+  }
+}
+
+/**
+ * The words of every label of a label dictionary, stored as ids of a word
+ * dictionary. Labels are split once, so consumers of the words never touch
+ * the label text again. The words of label i are
+ * tokens_[offsets_[i], offsets_[i + 1]).
+ */
+class TokenTable {
+ public:
+  using token_list_t = boost::iterator_range<const label_id_t*>;
+
+  TokenTable() : offsets_(std::vector<uint64_t>(1, 0)) {}
+
+  /**
+   * Split the labels that are not tokenized yet, so the table follows a
+   * dictionary that grows. New words are interned into words.
+   */
+  void Tokenize(const LabelDictionary& labels, LabelDictionary& words) {
+    if (size() == labels.size()) {
+      return;
+    }
+
+    auto& offsets = offsets_.Mutable();
+    auto& tokens = tokens_.Mutable();
+
+    for (label_id_t id = size(); id < labels.size(); id++) {
+      ForEachToken(labels.Get(id), [&tokens, &words](boost::string_view word) {
+        tokens.push_back(words.Intern(word));
+      });
+      offsets.push_back(tokens.size());
+    }
+  }
+
+  token_list_t Get(label_id_t label) const {
+    return token_list_t(tokens_.data() + offsets_[label],
+                        tokens_.data() + offsets_[label + 1]);
+  }
+
+  // The number of tokenized labels
+  label_id_t size() const { return offsets_.size() - 1; }
+
+  void Serialize(SnapshotWriter& writer) const {
+    writer.WriteVector(offsets_);
+    writer.WriteVector(tokens_);
+  }
+
+  void Deserialize(SnapshotReader& reader) {
+    reader.ReadVector(offsets_);
+    reader.ReadVector(tokens_);
+    CHECK(!offsets_.empty() && offsets_.back() == tokens_.size())
+        << "Corrupted snapshot";
+  }
+
+ private:
+  // Used in place when the table is read from a snapshot
+  CowArray<uint64_t> offsets_;
+  CowArray<label_id_t> tokens_;
+};
+
+}  // namespace her
+#endif  // HER_TOKENIZER_H_
@@ -27,5 +27,18 @@ uint32_t local_process_num(boost::mpi::communicator& comm) {
   return local_worker_num;
 }
 
+/**
+ * The communicator of the ranks of comm running on the same node as this
+ * rank, ranks keep their relative order.
+ */
+inline boost::mpi::communicator NodeCommunicator(
+    const boost::mpi::communicator& comm) {
+  MPI_Comm node_comm;
+
+  MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, comm.rank(), MPI_INFO_NULL,
+                      &node_comm);
+  return boost::mpi::communicator(node_comm, boost::mpi::comm_take_ownership);
+}
+
 }  // namespace her
 #endif  // HER_UTIL_H_
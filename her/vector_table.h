@@ -0,0 +1,141 @@
+#ifndef HER_VECTOR_TABLE_H_
+#define HER_VECTOR_TABLE_H_
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "glog/logging.h"
+#include "her/config.h"
+#include "her/memory_policy.h"
+#include "her/snapshot.h"
+
+namespace her {
+static constexpr size_t kVectorAlignment = 64;
+
+/**
+ * A table of dense vectors of the same dimension, stored as one row-major
+ * matrix. Rows are padded with zeros to a multiple of kVectorAlignment bytes,
+ * so every row starts at a cache line. The matrix is either owned or points
+ * into a mapped snapshot file, in the latter case ranks mapping the same file
+ * share its pages.
+ */
+template <typename T>
+class VectorTable {
+  static_assert(kVectorAlignment % sizeof(T) == 0,
+                "Unsupported coordinate type");
+
+ public:
+  using row_t = Eigen::Map<const dense_vector_t<T>>;
+
+  // Allocate n_rows zero vectors of dimension dim
+  void Init(size_t n_rows, size_t dim) {
+    n_rows_ = n_base_rows_ = n_rows;
+    dim_ = dim;
+    stride_ = Stride(dim);
+    data_ = Allocate(n_rows * stride_, owner_);
+    ClearExtension();
+  }
+
+  /**
+   * Append zero vectors until there are n_rows. The existing matrix is kept
+   * in place, appended rows go to an owned extension, so the rows of a
+   * mapped matrix stay shared.
+   */
+  void Grow(size_t n_rows) {
+    if (n_rows <= n_rows_) {
+      return;
+    }
+
+    size_t n_ext_rows = n_rows - n_base_rows_;
+
+    if (n_ext_rows > ext_capacity_) {
+      size_t capacity = std::max(n_ext_rows, 2 * ext_capacity_);
+      std::shared_ptr<const void> owner;
+      auto* ext = Allocate(capacity * stride_, owner);
+
+      std::copy_n(ext_, (n_rows_ - n_base_rows_) * stride_,
+                  const_cast<T*>(ext));
+      ext_ = ext;
+      ext_owner_ = owner;
+      ext_capacity_ = capacity;
+    }
+    n_rows_ = n_rows;
+  }
+
+  const T* RowData(size_t i) const {
+    return i < n_base_rows_ ? data_ + i * stride_
+                            : ext_ + (i - n_base_rows_) * stride_;
+  }
+
+  // Only valid for an owned matrix or appended rows
+  T* MutableRowData(size_t i) { return const_cast<T*>(RowData(i)); }
+
+  row_t Row(size_t i) const { return row_t(RowData(i), dim_); }
+
+  size_t size() const { return n_rows_; }
+
+  size_t dim() const { return dim_; }
+
+  size_t Bytes() const { return n_rows_ * stride_ * sizeof(T); }
+
+  void Serialize(SnapshotWriter& writer) const {
+    writer.WritePod<uint64_t>(n_rows_);
+    writer.WritePod<uint64_t>(dim_);
+    writer.WriteArrays<T>(
+        {std::make_pair(data_, n_base_rows_ * stride_),
+         std::make_pair(ext_, (n_rows_ - n_base_rows_) * stride_)});
+  }
+
+  /**
+   * The matrix is used in place, it keeps the mapping of the reader alive.
+   */
+  void Deserialize(SnapshotReader& reader) {
+    size_t n_values;
+
+    n_rows_ = n_base_rows_ = reader.ReadPod<uint64_t>();
+    dim_ = reader.ReadPod<uint64_t>();
+    stride_ = Stride(dim_);
+    data_ = reader.ReadArray<T>(n_values);
+    owner_ = reader.file();
+    ClearExtension();
+    CHECK_EQ(n_values, n_rows_ * stride_) << "Corrupted snapshot";
+    CHECK_EQ(reinterpret_cast<uintptr_t>(data_) % kVectorAlignment, 0)
+        << "Misaligned vectors in snapshot";
+  }
+
+ private:
+  static size_t Stride(size_t dim) {
+    size_t n = kVectorAlignment / sizeof(T);
+
+    return (dim + n - 1) / n * n;
+  }
+
+  // Allocate n_values aligned zeros, held by owner
+  static const T* Allocate(size_t n_values,
+                           std::shared_ptr<const void>& owner) {
+    return static_cast<const T*>(
+        AllocateZeroed(n_values * sizeof(T), kVectorAlignment, owner));
+  }
+
+  void ClearExtension() {
+    ext_ = nullptr;
+    ext_owner_.reset();
+    ext_capacity_ = 0;
+  }
+
+  size_t n_rows_{};
+  size_t n_base_rows_{};
+  size_t dim_{};
+  size_t stride_{};
+  const T* data_{};
+  // Either the allocated matrix or the mapped file holding it
+  std::shared_ptr<const void> owner_;
+  // Rows appended by Grow, row i is at ext_ + (i - n_base_rows_) * stride_
+  const T* ext_{};
+  size_t ext_capacity_{};
+  std::shared_ptr<const void> ext_owner_;
+};
+
+}  // namespace her
+#endif  // HER_VECTOR_TABLE_H_
@@ -1,37 +1,187 @@
 #ifndef HER_VERTEX_MAP_H_
 #define HER_VERTEX_MAP_H_
-#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+#include "her/oid.h"
+#include "her/snapshot.h"
+#include "her/worker_pool.h"
 
 namespace her {
+/**
+ * A bidirectional mapping between original ids (oid) and local ids (lid).
+ * Lids are dense and follow the insertion order. Oids are looked up either by
+ * direct array indexing, when they are dense or nearly dense, or through a
+ * flat open-addressing table of lids.
+ */
 template <typename OID_T, typename VID_T>
 class VertexMap {
  public:
-  bool AddVertex(const OID_T& oid, VID_T& lid) {
-    auto it = o2l_.find(oid);
+  enum class Mode : uint32_t { kDense, kHashed };
 
-    if (it == o2l_.end()) {
-      lid = l2o_.size();
+  VertexMap()
+      : mode_(Mode::kHashed),
+        slots_(std::vector<VID_T>(kInitialSlots, kInvalidLid)) {}
 
-      o2l_[oid] = lid;
-      l2o_.push_back(oid);
-      return true;
+  /**
+   * Build the map from oids, the i-th oid gets lid i. Slots are claimed with
+   * compare-and-swap, so the work is split among parallelism threads. Return
+   * false if an oid occurs more than once, the oid is stored in duplicate.
+   */
+  bool BulkBuild(std::vector<OID_T>&& oids, int parallelism,
+                 OID_T& duplicate) {
+    l2o_ = std::move(oids);
+    CHECK_LT(l2o_.size(), static_cast<size_t>(kInvalidLid))
+        << "Too many vertices";
+
+    size_t n = l2o_.size();
+
+    if (n > 0) {
+      auto minmax = std::minmax_element(l2o_.begin(), l2o_.end());
+
+      min_oid_ = *minmax.first;
+      max_oid_ = *minmax.second;
+    }
+
+    // The range of oids is span + 1, which overflows for 64-bit oids
+    uint64_t span = n == 0 ? 0 : Offset(max_oid_);
+
+    if (n > 0 && span < kMaxDenseRatio * n) {
+      mode_ = Mode::kDense;
+      slots_ = std::vector<VID_T>(span + 1, kInvalidLid);
     } else {
-      lid = it->second;
-      return false;
+      mode_ = Mode::kHashed;
+      slots_ = std::vector<VID_T>(SlotNum(n), kInvalidLid);
     }
+
+    std::atomic<bool> ok(true);
+    size_t n_threads = std::max(parallelism, 1);
+    size_t chunk_size = (n + n_threads - 1) / n_threads;
+
+    ParallelFor(n_threads, [&](size_t i) {
+      size_t begin = std::min(i * chunk_size, n);
+      size_t end = std::min(begin + chunk_size, n);
+
+      for (size_t lid = begin; lid < end; lid++) {
+        if (!Claim(static_cast<VID_T>(lid))) {
+          if (ok.exchange(false)) {
+            duplicate = l2o_[lid];
+          }
+          return;
+        }
+      }
+    });
+    return ok;
   }
 
-  bool GetLid(const OID_T& oid, VID_T& lid) const {
-    auto it = o2l_.find(oid);
+  bool AddVertex(const OID_T& oid, VID_T& lid) {
+    if (GetLid(oid, lid)) {
+      return false;
+    }
+
+    lid = l2o_.size();
+    CHECK_LT(lid, kInvalidLid) << "Too many vertices";
+
+    if (mode_ == Mode::kDense && !InDenseRange(oid)) {
+      OID_T min_oid = std::min(min_oid_, oid);
+      OID_T max_oid = std::max(max_oid_, oid);
+      uint64_t span = Offset(min_oid, max_oid);
 
-    if (it == o2l_.end()) {
+      if (span < kMaxDenseRatio * (l2o_.size() + 1)) {
+        std::vector<VID_T> slots(span + 1, kInvalidLid);
+
+        std::copy(slots_.begin(), slots_.end(),
+                  slots.begin() + Offset(min_oid, min_oid_));
+        slots_ = std::move(slots);
+        min_oid_ = min_oid;
+        max_oid_ = max_oid;
+      } else {
+        mode_ = Mode::kHashed;
+        Rehash(SlotNum(l2o_.size() + 1));
+      }
+    } else if (mode_ == Mode::kHashed &&
+               2 * (l2o_.size() + 1) > slots_.size()) {
+      Rehash(2 * slots_.size());
+    }
+
+    l2o_.Mutable().push_back(oid);
+    Claim(lid);
+    return true;
+  }
+
+  /**
+   * Remove the vertex of oid, its lid is returned. The lid is not reused,
+   * GetOid still returns the oid of a removed lid.
+   */
+  bool RemoveVertex(const OID_T& oid, VID_T& lid) {
+    if (!GetLid(oid, lid)) {
       return false;
     }
+    if (removed_.size() < l2o_.size()) {
+      removed_.resize(l2o_.size(), false);
+    }
+    removed_[lid] = true;
+
+    auto& slots = slots_.Mutable();
+
+    if (mode_ == Mode::kDense) {
+      slots[Offset(oid)] = kInvalidLid;
+      return true;
+    }
+
+    size_t mask = slots.size() - 1;
+    size_t hole = Hash(oid) & mask;
+
+    while (slots[hole] != lid) {
+      hole = (hole + 1) & mask;
+    }
+    // Move later entries of the probe sequence into the hole, unless the
+    // hole is before their home slot, so that no lookup stops early
+    for (size_t slot = (hole + 1) & mask; slots[slot] != kInvalidLid;
+         slot = (slot + 1) & mask) {
+      size_t home = Hash(l2o_[slots[slot]]) & mask;
 
-    lid = it->second;
+      if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+        slots[hole] = slots[slot];
+        hole = slot;
+      }
+    }
+    slots[hole] = kInvalidLid;
     return true;
   }
 
+  bool IsRemoved(const VID_T& lid) const {
+    return lid < removed_.size() && removed_[lid];
+  }
+
+  bool GetLid(const OID_T& oid, VID_T& lid) const {
+    if (mode_ == Mode::kDense) {
+      if (!InDenseRange(oid)) {
+        return false;
+      }
+      lid = slots_[Offset(oid)];
+      return lid != kInvalidLid;
+    }
+
+    size_t mask = slots_.size() - 1;
+
+    for (size_t slot = Hash(oid) & mask;; slot = (slot + 1) & mask) {
+      VID_T curr = slots_[slot];
+
+      if (curr == kInvalidLid) {
+        return false;
+      }
+      if (l2o_[curr] == oid) {
+        lid = curr;
+        return true;
+      }
+    }
+  }
+
   bool GetOid(const VID_T& lid, OID_T& oid) const {
     if (lid < l2o_.size()) {
       oid = l2o_[lid];
@@ -40,14 +190,401 @@ class VertexMap {
     return false;
   }
 
-  VID_T TotalVertexNum() const { return o2l_.size(); }
+  VID_T TotalVertexNum() const { return l2o_.size(); }
+
+  bool HasOid(const OID_T& oid) const {
+    VID_T lid;
+
+    return GetLid(oid, lid);
+  }
 
-  bool HasOid(const OID_T& oid) const { return o2l_.find(oid) != o2l_.end(); }
+  Mode mode() const { return mode_; }
+
+  void Serialize(SnapshotWriter& writer) const {
+    writer.WritePod(mode_);
+    writer.WritePod(min_oid_);
+    writer.WritePod(max_oid_);
+    writer.WriteVector(l2o_);
+    writer.WriteVector(slots_);
+
+    std::vector<VID_T> removed;
+
+    for (size_t lid = 0; lid < removed_.size(); lid++) {
+      if (removed_[lid]) {
+        removed.push_back(lid);
+      }
+    }
+    writer.WriteVector(removed);
+  }
+
+  void Deserialize(SnapshotReader& reader) {
+    mode_ = reader.ReadPod<Mode>();
+    min_oid_ = reader.ReadPod<OID_T>();
+    max_oid_ = reader.ReadPod<OID_T>();
+    reader.ReadVector(l2o_);
+    reader.ReadVector(slots_);
+
+    std::vector<VID_T> removed;
+
+    reader.ReadVector(removed);
+    removed_.assign(removed.empty() ? 0 : l2o_.size(), false);
+    for (auto lid : removed) {
+      CHECK_LT(lid, l2o_.size()) << "Corrupted snapshot";
+      removed_[lid] = true;
+    }
+  }
 
  private:
-  std::unordered_map<OID_T, VID_T> o2l_;
-  std::vector<OID_T> l2o_;
+  static constexpr VID_T kInvalidLid = std::numeric_limits<VID_T>::max();
+  static constexpr size_t kInitialSlots = 1024;
+  // Direct indexing is used if the oid range is at most kMaxDenseRatio times
+  // the number of vertices, the array is then no larger than a hash table.
+  static constexpr uint64_t kMaxDenseRatio = 2;
+
+  static uint64_t Hash(const OID_T& oid) {
+    uint64_t x = static_cast<uint64_t>(oid);
+
+    // finalizer of MurmurHash3
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+  }
+
+  static size_t SlotNum(size_t n) {
+    size_t n_slots = kInitialSlots;
+
+    while (n_slots < 2 * n) {
+      n_slots *= 2;
+    }
+    return n_slots;
+  }
+
+  static uint64_t Offset(const OID_T& min_oid, const OID_T& oid) {
+    return static_cast<uint64_t>(oid) - static_cast<uint64_t>(min_oid);
+  }
+
+  uint64_t Offset(const OID_T& oid) const { return Offset(min_oid_, oid); }
+
+  bool InDenseRange(const OID_T& oid) const {
+    return !l2o_.empty() && oid >= min_oid_ && oid <= max_oid_;
+  }
+
+  /**
+   * Put lid into the slot of its oid. It is safe to be called concurrently
+   * for different lids once the slots are owned, false is returned if the
+   * oid is already taken.
+   */
+  bool Claim(VID_T lid) {
+    const OID_T& oid = l2o_[lid];
+    auto& slots = slots_.Mutable();
+
+    if (mode_ == Mode::kDense) {
+      VID_T expected = kInvalidLid;
+
+      return __atomic_compare_exchange_n(&slots[Offset(oid)], &expected, lid,
+                                         false, __ATOMIC_RELAXED,
+                                         __ATOMIC_RELAXED);
+    }
+
+    size_t mask = slots.size() - 1;
+
+    for (size_t slot = Hash(oid) & mask;; slot = (slot + 1) & mask) {
+      VID_T expected = kInvalidLid;
+
+      if (__atomic_compare_exchange_n(&slots[slot], &expected, lid, false,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return true;
+      }
+      if (l2o_[expected] == oid) {
+        return false;
+      }
+    }
+  }
+
+  void Rehash(size_t n_slots) {
+    slots_ = std::vector<VID_T>(n_slots, kInvalidLid);
+    for (VID_T lid = 0; lid < l2o_.size(); lid++) {
+      if (!IsRemoved(lid)) {
+        Claim(lid);
+      }
+    }
+  }
+
+  Mode mode_;
+  OID_T min_oid_{};
+  OID_T max_oid_{};
+  // The arrays are used in place when the map is read from a snapshot
+  CowArray<OID_T> l2o_;
+  // lid of every oid in dense mode, otherwise an open-addressing table
+  CowArray<VID_T> slots_;
+  // Lids of removed vertices, empty if no vertex is removed
+  std::vector<bool> removed_;
 };
 
+template <typename OID_T, typename VID_T>
+constexpr VID_T VertexMap<OID_T, VID_T>::kInvalidLid;
+
+/**
+ * A vertex map of string oids. The oids are interned: they are stored back to
+ * back in one arena, in lid order, and looked up through an open-addressing
+ * table of lids. A 32-bit hash is kept per lid, so probing compares strings
+ * only on a hash match and the table is rebuilt without hashing strings
+ * again.
+ */
+template <typename VID_T>
+class VertexMap<std::string, VID_T> {
+ public:
+  enum class Mode : uint32_t { kDense, kHashed };
+
+  VertexMap() : slots_(std::vector<VID_T>(kInitialSlots, kInvalidLid)) {}
+
+  /**
+   * Build the map from oids, the i-th oid gets lid i. The oids are hashed and
+   * their slots are claimed with compare-and-swap by parallelism threads.
+   * Return false if an oid occurs more than once, the oid is stored in
+   * duplicate.
+   */
+  bool BulkBuild(StringList&& oids, int parallelism, std::string& duplicate) {
+    l2o_ = std::move(oids);
+    CHECK_LT(l2o_.size(), static_cast<size_t>(kInvalidLid))
+        << "Too many vertices";
+
+    size_t n = l2o_.size();
+    size_t n_threads = std::max(parallelism, 1);
+    size_t chunk_size = (n + n_threads - 1) / n_threads;
+    std::atomic<bool> ok(true);
+    // Run func(lid) for all lids by n_threads threads, a thread stops at the
+    // first lid func returns false for
+    auto for_each_lid = [n, n_threads, chunk_size](const auto& func) {
+      ParallelFor(n_threads, [&](size_t i) {
+        size_t begin = std::min(i * chunk_size, n);
+        size_t end = std::min(begin + chunk_size, n);
+
+        for (size_t lid = begin; lid < end; lid++) {
+          if (!func(static_cast<VID_T>(lid))) {
+            return;
+          }
+        }
+      });
+    };
+
+    auto& hashes = hashes_.Mutable();
+
+    hashes.resize(n);
+    slots_ = std::vector<VID_T>(SlotNum(n), kInvalidLid);
+    // All hashes are known before any slot is claimed, so claiming threads
+    // can compare the hashes of other lids
+    for_each_lid([this, &hashes](VID_T lid) {
+      hashes[lid] = Hash(l2o_[lid]);
+      return true;
+    });
+    for_each_lid([this, &ok, &duplicate](VID_T lid) {
+      if (!Claim(lid)) {
+        if (ok.exchange(false)) {
+          duplicate = l2o_[lid].to_string();
+        }
+        return false;
+      }
+      return true;
+    });
+    return ok;
+  }
+
+  bool AddVertex(boost::string_view oid, VID_T& lid) {
+    if (GetLid(oid, lid)) {
+      return false;
+    }
+
+    lid = l2o_.size();
+    CHECK_LT(lid, kInvalidLid) << "Too many vertices";
+
+    if (2 * (l2o_.size() + 1) > slots_.size()) {
+      Rehash(2 * slots_.size());
+    }
+    l2o_.push_back(oid);
+    hashes_.Mutable().push_back(Hash(oid));
+    Claim(lid);
+    return true;
+  }
+
+  /**
+   * Remove the vertex of oid, its lid is returned. The lid is not reused,
+   * GetOid still returns the oid of a removed lid.
+   */
+  bool RemoveVertex(boost::string_view oid, VID_T& lid) {
+    if (!GetLid(oid, lid)) {
+      return false;
+    }
+    if (removed_.size() < l2o_.size()) {
+      removed_.resize(l2o_.size(), false);
+    }
+    removed_[lid] = true;
+
+    auto& slots = slots_.Mutable();
+    size_t mask = slots.size() - 1;
+    size_t hole = hashes_[lid] & mask;
+
+    while (slots[hole] != lid) {
+      hole = (hole + 1) & mask;
+    }
+    // Move later entries of the probe sequence into the hole, unless the
+    // hole is before their home slot, so that no lookup stops early
+    for (size_t slot = (hole + 1) & mask; slots[slot] != kInvalidLid;
+         slot = (slot + 1) & mask) {
+      size_t home = hashes_[slots[slot]] & mask;
+
+      if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+        slots[hole] = slots[slot];
+        hole = slot;
+      }
+    }
+    slots[hole] = kInvalidLid;
+    return true;
+  }
+
+  bool IsRemoved(const VID_T& lid) const {
+    return lid < removed_.size() && removed_[lid];
+  }
+
+  bool GetLid(boost::string_view oid, VID_T& lid) const {
+    uint32_t hash = Hash(oid);
+    size_t mask = slots_.size() - 1;
+
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+      VID_T curr = slots_[slot];
+
+      if (curr == kInvalidLid) {
+        return false;
+      }
+      if (hashes_[curr] == hash && l2o_[curr] == oid) {
+        lid = curr;
+        return true;
+      }
+    }
+  }
+
+  bool GetOid(const VID_T& lid, std::string& oid) const {
+    if (lid < l2o_.size()) {
+      oid = l2o_[lid].to_string();
+      return true;
+    }
+    return false;
+  }
+
+  VID_T TotalVertexNum() const { return l2o_.size(); }
+
+  bool HasOid(boost::string_view oid) const {
+    VID_T lid;
+
+    return GetLid(oid, lid);
+  }
+
+  Mode mode() const { return Mode::kHashed; }
+
+  void Serialize(SnapshotWriter& writer) const {
+    l2o_.Serialize(writer);
+    writer.WriteVector(hashes_);
+    writer.WriteVector(slots_);
+
+    std::vector<VID_T> removed;
+
+    for (size_t lid = 0; lid < removed_.size(); lid++) {
+      if (removed_[lid]) {
+        removed.push_back(lid);
+      }
+    }
+    writer.WriteVector(removed);
+  }
+
+  void Deserialize(SnapshotReader& reader) {
+    l2o_.Deserialize(reader);
+    reader.ReadVector(hashes_);
+    reader.ReadVector(slots_);
+    CHECK(hashes_.size() == l2o_.size() &&
+          (slots_.size() & (slots_.size() - 1)) == 0 &&
+          slots_.size() >= 2 * hashes_.size())
+        << "Corrupted snapshot";
+
+    std::vector<VID_T> removed;
+
+    reader.ReadVector(removed);
+    removed_.assign(removed.empty() ? 0 : l2o_.size(), false);
+    for (auto lid : removed) {
+      CHECK_LT(lid, l2o_.size()) << "Corrupted snapshot";
+      removed_[lid] = true;
+    }
+  }
+
+ private:
+  static constexpr VID_T kInvalidLid = std::numeric_limits<VID_T>::max();
+  static constexpr size_t kInitialSlots = 1024;
+
+  // FNV-1a
+  static uint32_t Hash(boost::string_view oid) {
+    uint64_t hash = 14695981039346656037ull;
+
+    for (char c : oid) {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 1099511628211ull;
+    }
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+  }
+
+  static size_t SlotNum(size_t n) {
+    size_t n_slots = kInitialSlots;
+
+    while (n_slots < 2 * n) {
+      n_slots *= 2;
+    }
+    return n_slots;
+  }
+
+  /**
+   * Put lid into the slot of its oid. It is safe to be called concurrently
+   * for different lids once the slots are owned, false is returned if the
+   * oid is already taken.
+   */
+  bool Claim(VID_T lid) {
+    uint32_t hash = hashes_[lid];
+    auto& slots = slots_.Mutable();
+    size_t mask = slots.size() - 1;
+
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+      VID_T expected = kInvalidLid;
+
+      if (__atomic_compare_exchange_n(&slots[slot], &expected, lid, false,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return true;
+      }
+      if (hashes_[expected] == hash && l2o_[expected] == l2o_[lid]) {
+        return false;
+      }
+    }
+  }
+
+  void Rehash(size_t n_slots) {
+    slots_ = std::vector<VID_T>(n_slots, kInvalidLid);
+    for (VID_T lid = 0; lid < l2o_.size(); lid++) {
+      if (!IsRemoved(lid)) {
+        Claim(lid);
+      }
+    }
+  }
+
+  // The arrays are used in place when the map is read from a snapshot
+  StringList l2o_;
+  CowArray<uint32_t> hashes_;
+  // An open-addressing table of lids
+  CowArray<VID_T> slots_;
+  // Lids of removed vertices, empty if no vertex is removed
+  std::vector<bool> removed_;
+};
+
+template <typename VID_T>
+constexpr VID_T VertexMap<std::string, VID_T>::kInvalidLid;
+
 }  // namespace her
 #endif  // HER_VERTEX_MAP_H_
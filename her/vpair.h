@@ -23,7 +23,7 @@ class VPair {
 
     auto begin = GetCurrentTime();
     for (vertex_t v : vertices) {
-      if (h_v_(gd_, u, g_, v) >= sigma_) {
+      if (!g_.IsRemoved(v) && h_v_(gd_, u, g_, v) >= sigma_) {
         C.push_back(v);
       }
     }
@@ -0,0 +1,308 @@
+#ifndef HER_WORD_EMBEDDING_H_
+#define HER_WORD_EMBEDDING_H_
+#include <algorithm>
+#include <boost/utility/string_view.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+#include "her/config.h"
+#include "her/label_dictionary.h"
+#include "her/input_file.h"
+#include "her/snapshot.h"
+#include "her/tokenizer.h"
+#include "her/vector_table.h"
+#include "her/worker_pool.h"
+
+namespace her {
+/**
+ * Pre-trained word vectors stored as one VectorTable, the row of a word is
+ * its id in a dictionary of the words.
+ */
+template <typename T>
+class WordEmbedding {
+ public:
+  using row_t = typename VectorTable<T>::row_t;
+
+  /**
+   * Load a text file, each line holds a word followed by its vector. The
+   * file is parsed by parallelism threads, a gzip file is inflated while it
+   * is parsed. Words are lower-cased,
+   * the last line wins if a word occurs more than once. The dimension is
+   * given by the first line, lines with fewer values are skipped. If
+   * vocabulary is given, only words in it are kept and the vectors of other
+   * words are not parsed at all.
+   */
+  void Load(const std::string& path, int parallelism,
+            const LabelDictionary* vocabulary = nullptr) {
+    size_t n_threads = std::max(parallelism, 1);
+    InputFile file(path, n_threads, n_threads);
+    std::deque<InputBlock> taken;
+    std::mutex block_mutex;
+    InputBlock head;
+    std::string buf, first_word;
+    std::vector<T> first_values;
+    bool found = false;
+
+    // The dimension is required before the blocks are parsed, blocks read
+    // to find it are parsed later like the others
+    while (!found && file.NextBlock(head)) {
+      const char* p = head.begin;
+
+      while (!found && p < head.end) {
+        auto line = NextLine(p, head.end);
+
+        found = ParseLine(line, 0, nullptr, buf, first_word, first_values) ==
+                LineStatus::kParsed;
+      }
+      taken.push_back(std::move(head));
+    }
+    size_t dim = first_values.size();
+
+    struct Chunk {
+      std::string words;
+      std::vector<size_t> word_ends;
+      std::vector<T> values;
+      size_t n_skipped = 0;
+      size_t n_pruned = 0;
+    };
+
+    std::vector<Chunk> chunks;
+    auto next_block = [&file, &taken, &block_mutex](InputBlock& block) {
+      {
+        std::lock_guard<std::mutex> lock(block_mutex);
+
+        if (!taken.empty()) {
+          block = std::move(taken.front());
+          taken.pop_front();
+          return true;
+        }
+      }
+      return file.NextBlock(block);
+    };
+
+    ParallelFor(n_threads, [dim, vocabulary, &next_block, &chunks,
+                            &block_mutex](size_t) {
+      InputBlock block;
+      std::string buf, word;
+      std::vector<T> values;
+
+      while (next_block(block)) {
+        const char* p = block.begin;
+        Chunk chunk;
+
+        while (p < block.end) {
+          auto line = NextLine(p, block.end);
+
+          if (IsBlankLine(line)) {
+            continue;
+          }
+
+          auto status = ParseLine(line, dim, vocabulary, buf, word, values);
+
+          if (status != LineStatus::kParsed) {
+            if (status == LineStatus::kPruned) {
+              chunk.n_pruned++;
+            } else {
+              chunk.n_skipped++;
+            }
+            continue;
+          }
+          chunk.words.append(word);
+          chunk.word_ends.push_back(chunk.words.size());
+          chunk.values.insert(chunk.values.end(), values.begin(),
+                              values.end());
+        }
+
+        std::lock_guard<std::mutex> lock(block_mutex);
+
+        if (chunks.size() <= block.index) {
+          chunks.resize(block.index + 1);
+        }
+        chunks[block.index] = std::move(chunk);
+      }
+    });
+
+    // Intern in file order, so the row of a word is taken from its last line
+    std::vector<std::pair<uint32_t, size_t>> sources;
+    size_t n_skipped = 0;
+
+    words_ = LabelDictionary();
+    n_pruned_ = 0;
+    for (uint32_t i = 0; i < chunks.size(); i++) {
+      auto& chunk = chunks[i];
+      size_t begin = 0;
+
+      for (size_t j = 0; j < chunk.word_ends.size(); j++) {
+        auto id = words_.Intern(boost::string_view(
+            chunk.words.data() + begin, chunk.word_ends[j] - begin));
+
+        if (id == sources.size()) {
+          sources.emplace_back(i, j);
+        } else {
+          sources[id] = std::make_pair(i, j);
+        }
+        begin = chunk.word_ends[j];
+      }
+      n_skipped += chunk.n_skipped;
+      n_pruned_ += chunk.n_pruned;
+    }
+
+    LOG_IF(WARNING, n_skipped > 0)
+        << "Skipped " << n_skipped << " lines of " << path
+        << " with less than " << dim << " values";
+
+    vectors_.Init(sources.size(), dim);
+
+    size_t rows_per_thread = (sources.size() + n_threads - 1) / n_threads;
+
+    ParallelFor(n_threads, [&](size_t i) {
+      size_t begin = std::min(i * rows_per_thread, sources.size());
+      size_t end = std::min(begin + rows_per_thread, sources.size());
+
+      for (size_t row = begin; row < end; row++) {
+        auto& chunk = chunks[sources[row].first];
+
+        std::copy_n(chunk.values.data() + sources[row].second * dim,
+                    dim, vectors_.MutableRowData(row));
+      }
+    });
+  }
+
+  /**
+   * The vector of word, or nullptr if the word is unknown. The vector has
+   * dim() values.
+   */
+  const T* Find(boost::string_view word) const {
+    label_id_t row;
+
+    if (!words_.Find(word, row)) {
+      return nullptr;
+    }
+    return vectors_.RowData(row);
+  }
+
+  row_t Row(const T* row) const { return row_t(row, dim()); }
+
+  boost::string_view Word(size_t row) const { return words_.Get(row); }
+
+  size_t size() const { return words_.size(); }
+
+  size_t dim() const { return vectors_.dim(); }
+
+  // The number of lines skipped by the vocabulary of the last Load
+  size_t n_pruned() const { return n_pruned_; }
+
+  size_t MatrixBytes() const { return vectors_.Bytes(); }
+
+  void Serialize(SnapshotWriter& writer) const {
+    words_.Serialize(writer);
+    vectors_.Serialize(writer);
+  }
+
+  /**
+   * The vectors are used in place, they keep the mapping of the reader
+   * alive.
+   */
+  void Deserialize(SnapshotReader& reader) {
+    words_.Deserialize(reader);
+    vectors_.Deserialize(reader);
+    CHECK_EQ(vectors_.size(), words_.size()) << "Corrupted snapshot";
+  }
+
+ private:
+  static bool IsBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+  }
+
+  // The line starting at p without its '\n', p is moved to the next line
+  static boost::string_view NextLine(const char*& p, const char* end) {
+    auto* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+    const char* line_end = nl == nullptr ? end : nl;
+    boost::string_view line(p, line_end - p);
+
+    p = nl == nullptr ? end : nl + 1;
+    return line;
+  }
+
+  static bool IsBlankLine(boost::string_view line) {
+    return std::all_of(line.begin(), line.end(), IsBlank);
+  }
+
+  static float ParseValue(const char* p, char** next, float) {
+    return std::strtof(p, next);
+  }
+
+  static double ParseValue(const char* p, char** next, double) {
+    return std::strtod(p, next);
+  }
+
+  enum class LineStatus { kParsed, kPruned, kBad };
+
+  /**
+   * Split a line into the lower-cased word and its values. If dim is 0, all
+   * values of the line are taken, otherwise the first dim values. The values
+   * are not parsed if vocabulary is given and the word is not in it.
+   */
+  static LineStatus ParseLine(boost::string_view line, size_t dim,
+                              const LabelDictionary* vocabulary,
+                              std::string& buf, std::string& word,
+                              std::vector<T>& values) {
+    const char* p = line.begin();
+    const char* end = line.end();
+
+    while (p < end && IsBlank(*p)) {
+      p++;
+    }
+
+    const char* word_begin = p;
+
+    while (p < end && !IsBlank(*p)) {
+      p++;
+    }
+    if (p == word_begin) {
+      return LineStatus::kBad;
+    }
+    word.assign(word_begin, p);
+    ToLowerAscii(&word[0], &word[0] + word.size());
+
+    label_id_t id;
+
+    if (vocabulary != nullptr && !vocabulary->Find(word, id)) {
+      return LineStatus::kPruned;
+    }
+
+    // strtof requires a null-terminated string
+    buf.assign(p, end - p);
+
+    const char* q = buf.c_str();
+
+    values.clear();
+    while (dim == 0 || values.size() < dim) {
+      char* next;
+      T val = ParseValue(q, &next, T());
+
+      if (next == q) {
+        break;
+      }
+      values.push_back(val);
+      q = next;
+    }
+    if (dim == 0 ? values.empty() : values.size() < dim) {
+      return LineStatus::kBad;
+    }
+    return LineStatus::kParsed;
+  }
+
+  LabelDictionary words_;
+  VectorTable<T> vectors_;
+  size_t n_pruned_{};
+};
+
+}  // namespace her
+#endif  // HER_WORD_EMBEDDING_H_
@@ -0,0 +1,154 @@
+#ifndef HER_WORKER_POOL_H_
+#define HER_WORKER_POOL_H_
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace her {
+/**
+ * A fixed set of worker threads running jobs and the chunks of parallel
+ * loops. Queued chunks are taken before jobs, so a loop that is under way
+ * finishes before new jobs start. A worker that runs a loop by RunChunks
+ * takes queued chunks, of its own loop or of others, until its loop is
+ * finished, so a pool never runs more threads than it has workers.
+ */
+class WorkerPool {
+ public:
+  explicit WorkerPool(size_t n_workers) {
+    for (size_t i = 0; i < std::max<size_t>(n_workers, 1); i++) {
+      workers_.push_back(std::thread([this]() { Work(); }));
+    }
+  }
+
+  // Wait for the queued jobs and chunks, then stop the workers
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      stopped_ = true;
+    }
+    cv_.notify_all();
+    for (auto& th : workers_) {
+      th.join();
+    }
+  }
+
+  // The pool of the calling worker, or nullptr if it is not a worker
+  static WorkerPool*& Current() {
+    static thread_local WorkerPool* pool = nullptr;
+
+    return pool;
+  }
+
+  void Submit(std::function<void()> job) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      jobs_.push(std::move(job));
+    }
+    // Workers waiting in RunChunks only take chunks, so all are woken
+    cv_.notify_all();
+  }
+
+  /**
+   * Run func(i) for all i in [0, n) by the workers of the pool, return when
+   * all of them are finished. The calling worker runs chunks as well.
+   */
+  void RunChunks(size_t n, const std::function<void(size_t)>& func) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t n_left = n;
+
+    for (size_t i = 0; i < n; i++) {
+      chunks_.push([this, &func, &n_left, i]() {
+        func(i);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (--n_left == 0) {
+          cv_.notify_all();
+        }
+      });
+    }
+    cv_.notify_all();
+    while (n_left > 0) {
+      if (chunks_.empty()) {
+        cv_.wait(lock);
+        continue;
+      }
+
+      auto chunk = std::move(chunks_.front());
+
+      chunks_.pop();
+      lock.unlock();
+      chunk();
+      lock.lock();
+    }
+  }
+
+ private:
+  void Work() {
+    Current() = this;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+      std::function<void()> job;
+
+      if (!chunks_.empty()) {
+        job = std::move(chunks_.front());
+        chunks_.pop();
+      } else if (!jobs_.empty()) {
+        job = std::move(jobs_.front());
+        jobs_.pop();
+      } else if (stopped_) {
+        break;
+      } else {
+        cv_.wait(lock);
+        continue;
+      }
+      lock.unlock();
+      job();
+      lock.lock();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::queue<std::function<void()>> jobs_;
+  std::queue<std::function<void()>> chunks_;
+  bool stopped_{};
+};
+
+/**
+ * Run func(i) for all i in [0, n) in parallel. Called by a worker of a
+ * WorkerPool, e.g. by a task of a TaskGraph, the chunks are run by that pool
+ * and share its workers with the loops of other tasks. Otherwise every chunk
+ * gets a thread of its own.
+ */
+template <typename FUNC_T>
+void ParallelFor(size_t n, const FUNC_T& func) {
+  auto* pool = WorkerPool::Current();
+
+  if (pool != nullptr) {
+    pool->RunChunks(n, func);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+
+  for (size_t i = 0; i < n; i++) {
+    threads.push_back(std::thread([&func, i]() { func(i); }));
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+}
+
+}  // namespace her
+#endif  // HER_WORKER_POOL_H_